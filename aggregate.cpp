@@ -0,0 +1,168 @@
+#include "aggregate.hpp"
+#include "record.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <boost/scoped_ptr.hpp>
+
+namespace janosh {
+  static void printNumber(std::ostream& out, const double d) {
+    if(d == std::floor(d) && std::fabs(d) < 9007199254740992.0)
+      out << static_cast<int64_t>(d) << std::endl;
+    else
+      out << boost::lexical_cast<string>(d) << std::endl;
+  }
+
+  /**
+   * Compiles an aggregation.
+   * @param op the operation: count, sum, min, max, avg or distinct.
+   * @param pattern the aggregated field, like /stats/ * /bytes (without the blanks).
+   */
+  Aggregate::Aggregate(const string& op, const string& pattern) :
+    count(0),
+    numbers(0),
+    sum(0),
+    min(std::numeric_limits<double>::max()),
+    max(-std::numeric_limits<double>::max()) {
+    if(op == "count")
+      this->op = Count;
+    else if(op == "sum")
+      this->op = Sum;
+    else if(op == "min")
+      this->op = Min;
+    else if(op == "max")
+      this->op = Max;
+    else if(op == "avg")
+      this->op = Avg;
+    else if(op == "distinct")
+      this->op = Distinct;
+    else
+      throw aggregate_exception() << string_info({"unknown aggregate", op});
+
+    const size_t pos = pattern.find("/*");
+    if(pos == string::npos || (pos + 2 < pattern.size() && pattern[pos + 2] != '/') || pattern.find('*', pos + 2) != string::npos)
+      throw aggregate_exception() << string_info({"expected one wildcard member in pattern", pattern});
+
+    const string dir = pattern.substr(0, pos);
+    const string field = pattern.substr(pos + 2);
+    this->dirPrefix = (dir.empty() ? "" : Path(dir).key()) + '/';
+    this->suffix = field.empty() ? "" : Path(field).key();
+  }
+
+  /**
+   * @return the key prefix of the members of the aggregated directory.
+   */
+  const string& Aggregate::prefix() const {
+    return this->dirPrefix;
+  }
+
+  /**
+   * @return number of aggregated fields.
+   */
+  size_t Aggregate::size() const {
+    return this->count;
+  }
+
+  void Aggregate::add(const string& raw) {
+    const Value v(raw, false);
+    ++count;
+
+    if(op == Distinct) {
+      texts.insert(v.str());
+      return;
+    }
+
+    if(op == Count)
+      return;
+
+    double d;
+    if(v.isNumber()) {
+      d = v.getReal();
+    } else {
+      char* end = NULL;
+      if(v.getType() != Value::String || v.str().empty())
+        return;
+      d = strtod(v.str().c_str(), &end);
+      if(*end != '\0')
+        return;
+    }
+
+    ++numbers;
+    sum += d;
+    if(d < min)
+      min = d;
+    if(d > max)
+      max = d;
+  }
+
+  /**
+   * Aggregates the fields of the members in a key range with one cursor.
+   * The subtree of a member is left with a single jump once its field was read.
+   * @param start the key to start at, the first member if empty.
+   * @param end the key to stop before, the end of the directory if empty.
+   */
+  void Aggregate::scan(const string& start, const string& end) {
+    boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+    const string header = dirPrefix + '!';
+    const size_t p = dirPrefix.size();
+    string key, value;
+
+    if(!cur->jump(start.empty() ? dirPrefix : start))
+      return;
+
+    while(cur->get(&key, &value) && key.compare(0, p, dirPrefix) == 0 && (end.empty() || key < end)) {
+      if(key == header) {
+        cur->step();
+        continue;
+      }
+
+      const size_t slash = key.find('/', p);
+      const string field = key.substr(0, slash) + suffix;
+
+      if(key == field)
+        add(value);
+
+      if(slash != string::npos && key < field)
+        cur->jump(field);
+      else if(!Record::skipMember(*cur, key, p))
+        break;
+    }
+  }
+
+  /**
+   * Adds the state of an aggregation over another part of the same directory.
+   */
+  void Aggregate::merge(const Aggregate& other) {
+    count += other.count;
+    numbers += other.numbers;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    texts.insert(other.texts.begin(), other.texts.end());
+  }
+
+  /**
+   * Prints the result. min, max and avg print null if there were no numbers.
+   */
+  void Aggregate::print(std::ostream& out) const {
+    switch(op) {
+      case Count:
+        out << count << std::endl;
+        break;
+      case Distinct:
+        out << texts.size() << std::endl;
+        break;
+      case Sum:
+        printNumber(out, sum);
+        break;
+      case Min:
+      case Max:
+      case Avg:
+        if(numbers == 0)
+          out << "null" << std::endl;
+        else
+          printNumber(out, op == Min ? min : (op == Max ? max : sum / numbers));
+        break;
+    }
+  }
+}
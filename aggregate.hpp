@@ -0,0 +1,54 @@
+#ifndef _JANOSH_AGGREGATE_HPP
+#define _JANOSH_AGGREGATE_HPP
+
+#include <string>
+#include <set>
+#include <iostream>
+#include <stdint.h>
+
+#include "logger.hpp"
+#include "exception.hpp"
+
+namespace janosh {
+  using std::string;
+
+  /**
+   * Aggregates a field of the members of a directory, declared by a pattern like /stats/ * /bytes
+   * (without the blanks), during a cursor scan of the directory. Without a field the member values are aggregated.
+   * Operations are count, sum, min, max, avg and distinct.
+   * count counts the members holding the field, distinct the different texts of the field.
+   * sum, min, max and avg use numbers and strings holding a number, other values are skipped.
+   * Only leaves are aggregated, a field that is a directory doesn't count.
+   */
+  class Aggregate {
+  public:
+    enum Op {
+      Count, Sum, Min, Max, Avg, Distinct
+    };
+
+    Aggregate(const string& op, const string& pattern);
+
+    const string& prefix() const;
+    void scan(const string& start, const string& end);
+    void merge(const Aggregate& other);
+    void print(std::ostream& out) const;
+    size_t size() const;
+  private:
+    Op op;
+    string dirPrefix;
+    string suffix;
+
+    size_t count;
+    size_t numbers;
+    double sum;
+    double min;
+    double max;
+    std::set<string> texts;
+
+    void add(const string& raw);
+  };
+
+  struct aggregate_exception : virtual janosh_exception { };
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include "backup.hpp"
+#include <cstring>
+#include <fstream>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace janosh {
+  const char Backup::magic[8] = { 'J', 'B', 'A', 'K', '0', '0', '0', '1' };
+
+  static void writeBlock(std::ostream& os, const uint32_t records, const string& payload) {
+    boost::crc_32_type crc;
+    crc.process_bytes(payload.data(), payload.size());
+    const uint32_t size = payload.size();
+    const uint32_t checksum = crc.checksum();
+
+    os.write(reinterpret_cast<const char*>(&records), sizeof(records));
+    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    os.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    os.write(payload.data(), payload.size());
+  }
+
+  /**
+   * Writes all records of an engine as a backup file.
+   * The file is written under a temporary name and renamed when complete.
+   * @return number of records written.
+   */
+  size_t Backup::write(Engine& source, const string& path) {
+    const string tmp = path + ".tmp";
+    std::ofstream os(tmp.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    os.write(magic, sizeof(magic));
+
+    string payload;
+    payload.reserve(blockSize);
+    uint32_t blockRecords = 0;
+    size_t cnt = 0;
+
+    boost::scoped_ptr<Engine::Cursor> cur(source.cursor());
+    string key, value;
+    cur->jump();
+    while(cur->get(&key, &value, true)) {
+      if(sizeof(uint32_t) * 2 + key.size() + value.size() > maxRecordSize)
+        throw engine_exception() << string_info({"record too large for a backup", key});
+
+      const uint32_t ksize = key.size();
+      const uint32_t vsize = value.size();
+      payload.append(reinterpret_cast<const char*>(&ksize), sizeof(ksize));
+      payload.append(reinterpret_cast<const char*>(&vsize), sizeof(vsize));
+      payload.append(key);
+      payload.append(value);
+      ++blockRecords;
+      ++cnt;
+
+      if(payload.size() >= blockSize) {
+        writeBlock(os, blockRecords, payload);
+        payload.clear();
+        blockRecords = 0;
+      }
+    }
+
+    if(blockRecords > 0)
+      writeBlock(os, blockRecords, payload);
+    writeBlock(os, 0, "");
+    os.close();
+
+    if(!os.good())
+      throw engine_exception() << string_info({"failed to write backup", tmp});
+
+    boost::filesystem::rename(tmp, path);
+    return cnt;
+  }
+
+  /**
+   * Writes all records of a backup file to an engine and the update log.
+   * Every block is verified before its records are written. Keys have to be strictly ascending across the file.
+   * The caller is expected to run this within a transaction, so a broken file leaves the engine untouched.
+   * @return number of records read.
+   */
+  size_t Backup::read(const string& path, Engine& dest, UpdateLog& log) {
+    std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+    char m[sizeof(magic)];
+    if(!is.read(m, sizeof(m)) || memcmp(m, magic, sizeof(magic)) != 0)
+      throw engine_exception() << string_info({"not a backup file", path});
+
+    string payload;
+    string key, value, last;
+    size_t cnt = 0;
+
+    while(true) {
+      uint32_t records, size, checksum;
+      is.read(reinterpret_cast<char*>(&records), sizeof(records));
+      is.read(reinterpret_cast<char*>(&size), sizeof(size));
+      is.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
+      if(!is)
+        throw engine_exception() << string_info({"truncated backup file", path});
+
+      if(records == 0)
+        break;
+
+      // the size isn't covered by the checksum, a broken one must not allocate gigabytes
+      if(size > maxBlockSize)
+        throw engine_exception() << string_info({"broken backup block", path});
+
+      payload.resize(size);
+      if(!is.read(&payload[0], size))
+        throw engine_exception() << string_info({"truncated backup file", path});
+
+      boost::crc_32_type crc;
+      crc.process_bytes(payload.data(), payload.size());
+      if(crc.checksum() != checksum)
+        throw engine_exception() << string_info({"backup block checksum mismatch", path});
+
+      const char* p = payload.data();
+      const char* end = p + payload.size();
+      for(uint32_t i = 0; i < records; ++i) {
+        uint32_t ksize, vsize;
+        if(end - p < static_cast<ptrdiff_t>(sizeof(ksize) + sizeof(vsize)))
+          throw engine_exception() << string_info({"broken backup block", path});
+
+        memcpy(&ksize, p, sizeof(ksize));
+        memcpy(&vsize, p + sizeof(ksize), sizeof(vsize));
+        p += sizeof(ksize) + sizeof(vsize);
+        if(static_cast<size_t>(end - p) < static_cast<size_t>(ksize) + vsize)
+          throw engine_exception() << string_info({"broken backup block", path});
+
+        key.assign(p, ksize);
+        value.assign(p + ksize, vsize);
+        p += ksize + vsize;
+
+        if(cnt > 0 && key <= last)
+          throw engine_exception() << string_info({"backup keys out of order", key});
+
+        if(!dest.set(key, value))
+          throw engine_exception() << string_info({"failed to restore record", key});
+        log.set(key, value);
+
+        last.swap(key);
+        ++cnt;
+      }
+
+      if(p != end)
+        throw engine_exception() << string_info({"broken backup block", path});
+    }
+
+    return cnt;
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef _JANOSH_BACKUP_HPP
+#define _JANOSH_BACKUP_HPP
+
+#include <string>
+#include <stdint.h>
+
+#include "engine.hpp"
+#include "updatelog.hpp"
+
+namespace janosh {
+  using std::string;
+
+  /**
+   * Binary backup of all records as they are stored, written and read as a single sequential stream.
+   * Restoring neither parses JSON nor decodes values, the records are written in key order as they are read.
+   *
+   * File layout (native byte order):
+   *   header:  char[8] magic
+   *   blocks:  uint32 record count | uint32 payload size | uint32 crc32 of the payload | payload
+   *   payload: uint32 key size | uint32 value size | key | value   (in key order)
+   *   trailer: a block with record count 0 and payload size 0
+   * A record may take at most maxRecordSize bytes, so no block is larger than maxBlockSize.
+   */
+  class Backup {
+  public:
+    static size_t write(Engine& source, const string& path);
+    static size_t read(const string& path, Engine& dest, UpdateLog& log);
+  private:
+    static const char magic[8];
+    static const size_t blockSize = 1 << 20;
+    // a block ends with the record that reaches blockSize, so it holds at most one record more than that
+    static const size_t maxRecordSize = 63 * blockSize;
+    static const size_t maxBlockSize = blockSize + maxRecordSize;
+  };
+}
+
+#endif
@@ -18,13 +18,13 @@ namespace janosh {
         out(out){
     }
 
-    void beginArray(const Path& p, bool first) {
+    void beginArray(const Path& p, const Value& value, bool array, bool first) {
     }
 
     void endArray(const Path& p) {
     }
 
-    void beginObject(const Path& p, bool first) {
+    void beginObject(const Path& p, const Value& value, bool array, bool first) {
     }
 
     void endObject(const Path& p) {
@@ -38,8 +38,8 @@ namespace janosh {
       out << ")" << endl;
     }
 
-    void record(const Path& p, const string& value, bool array, bool first) {
-        string stripped = value;
+    void record(const Path& p, const Value& value, bool array, bool first) {
+        string stripped = value.str();
         replace(stripped.begin(), stripped.end(), '\n', ' ');
         boost::algorithm::replace_all(stripped, "&",  "&#39;");
         out  << '[' << p.pretty() << "]='" << stripped << "' ";
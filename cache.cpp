@@ -0,0 +1,158 @@
+#include "cache.hpp"
+#include <boost/bind.hpp>
+
+namespace janosh {
+  RecordCache::RecordCache() :
+    budget(0),
+    used(0),
+    counters({0, 0}) {
+    // entries read within an aborted transaction may hold values that were rolled back
+    Transaction::listen(boost::bind(&RecordCache::finish, this, _1));
+  }
+
+  /**
+   * Sets the memory budget and drops all entries.
+   * @param bytes the approximate number of bytes the entries may take, 0 disables the cache.
+   */
+  void RecordCache::setBudget(size_t bytes) {
+    clear();
+    boost::lock_guard<boost::mutex> lock(mutex);
+    this->budget = bytes;
+  }
+
+  bool RecordCache::enabled() const {
+    return this->budget > 0;
+  }
+
+  const RecordCache::Stats& RecordCache::stats() const {
+    return counters;
+  }
+
+  /**
+   * The approximate memory an entry takes: the key twice, the encoded and the decoded value and some bookkeeping.
+   */
+  size_t RecordCache::cost(const string& key, const Value& value) {
+    return 2 * key.size() + value.encoded().size() + value.str().size() + 128;
+  }
+
+  /**
+   * Looks up a record and marks it as recently used.
+   * @param value receives the decoded value on a hit.
+   * @return true on a hit.
+   */
+  bool RecordCache::find(const string& key, Value& value) {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    auto it = index.find(key);
+    if(it == index.end()) {
+      ++counters.misses;
+      return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    value = it->second->second;
+    ++counters.hits;
+    return true;
+  }
+
+  /**
+   * Adds a record, evicting the least recently used ones until the budget is met.
+   */
+  void RecordCache::put(const string& key, const Value& value) {
+    const size_t c = cost(key, value);
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if(c > budget)
+      return;
+
+    auto it = index.find(key);
+    if(it != index.end())
+      erase(it);
+
+    while(used + c > budget)
+      erase(index.find(entries.back().first));
+
+    entries.push_front({key, value});
+    index[key] = entries.begin();
+    used += c;
+  }
+
+  void RecordCache::invalidate(const string& key) {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if(index.empty())
+      return;
+
+    auto it = index.find(key);
+    if(it != index.end())
+      erase(it);
+  }
+
+  void RecordCache::clear() {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    used = 0;
+  }
+
+  void RecordCache::finish(bool commit) {
+    if(!commit)
+      clear();
+  }
+
+  void RecordCache::erase(std::unordered_map<string, Entries::iterator>::iterator it) {
+    used -= cost(it->first, it->second->second);
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  DirectoryCache::DirectoryCache() {
+    Transaction::listen(boost::bind(&DirectoryCache::finish, this, _1));
+  }
+
+  bool DirectoryCache::isHeader(const string& key) {
+    return key.size() >= 2 && key[key.size() - 1] == '!' && key[key.size() - 2] == '/';
+  }
+
+  /**
+   * @param entry receives type and size of the directory on a hit.
+   * @return true on a hit.
+   */
+  bool DirectoryCache::find(const string& key, Entry& entry) const {
+    auto it = entries.find(key);
+    if(it == entries.end())
+      return false;
+
+    entry = it->second;
+    return true;
+  }
+
+  void DirectoryCache::put(const string& key, const Entry& entry) {
+    entries[key] = entry;
+  }
+
+  /**
+   * Follows a write. Only directory headers that are cached are decoded.
+   */
+  void DirectoryCache::written(const string& key, const string& value) {
+    if(entries.empty() || !isHeader(key))
+      return;
+
+    auto it = entries.find(key);
+    if(it != entries.end()) {
+      const Value header(value, true);
+      it->second = { header.getType(), header.getSize() };
+    }
+  }
+
+  void DirectoryCache::erased(const string& key) {
+    if(!entries.empty() && isHeader(key))
+      entries.erase(key);
+  }
+
+  void DirectoryCache::clear() {
+    entries.clear();
+  }
+
+  void DirectoryCache::finish(bool commit) {
+    if(!commit)
+      clear();
+  }
+}
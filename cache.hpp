@@ -0,0 +1,85 @@
+#ifndef _JANOSH_CACHE_HPP
+#define _JANOSH_CACHE_HPP
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "logger.hpp"
+#include "exception.hpp"
+#include "value.hpp"
+#include "engine.hpp"
+
+namespace janosh {
+  using std::string;
+
+  /**
+   * Bounded least recently used cache of decoded records, keyed by the encoded path.
+   * Holds existing records only. Every mutation of a key invalidates its entry, a clear or an aborted
+   * transaction drops all entries, as does reopening the database, which other processes may have written in between.
+   * A budget of 0 bytes disables the cache. Safe for concurrent use.
+   */
+  class RecordCache {
+  public:
+    struct Stats {
+      uint64_t hits;
+      uint64_t misses;
+    };
+
+    RecordCache();
+
+    void setBudget(size_t bytes);
+    bool enabled() const;
+    const Stats& stats() const;
+
+    bool find(const string& key, Value& value);
+    void put(const string& key, const Value& value);
+    void invalidate(const string& key);
+    void clear();
+  private:
+    typedef std::list<std::pair<string, Value> > Entries;
+
+    Entries entries;
+    std::unordered_map<string, Entries::iterator> index;
+    size_t budget;
+    size_t used;
+    Stats counters;
+    boost::mutex mutex;
+
+    static size_t cost(const string& key, const Value& value);
+    void finish(bool commit);
+    void erase(std::unordered_map<string, Entries::iterator>::iterator it);
+  };
+
+  /**
+   * Type and size of the directories read while the database is open, keyed by the key of the directory header.
+   * The open database is locked against writers of other processes, so the entries only have to follow
+   * the writes of this process: every header written through Record::written updates its entry,
+   * a removed header drops it. A clear, an aborted transaction or reopening the database drops all entries.
+   */
+  class DirectoryCache {
+  public:
+    struct Entry {
+      Value::Type type;
+      size_t size;
+    };
+
+    DirectoryCache();
+
+    bool find(const string& key, Entry& entry) const;
+    void put(const string& key, const Entry& entry);
+    void written(const string& key, const string& value);
+    void erased(const string& key);
+    void clear();
+  private:
+    std::unordered_map<string, Entry> entries;
+
+    static bool isHeader(const string& key);
+    void finish(bool commit);
+  };
+}
+
+#endif
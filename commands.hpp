@@ -141,6 +141,21 @@ public:
   }
 };
 
+class MigrateCommand: public Command {
+public:
+  MigrateCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (!params.empty())
+      return {0, "Migrate doesn't take any arguments"};
+
+    janosh->migrate();
+    return {1, "Successful"};
+  }
+};
+
 class AddCommand: public Command {
 public:
   AddCommand(janosh::Janosh* janosh) :
@@ -151,14 +166,7 @@ public:
     if (params.size() % 2 != 0) {
       return {-1, "Expected a list of path/value pairs"};
     } else {
-      const string path = params.front();
-
-      for (auto it = params.begin(); it != params.end(); it += 2) {
-        if (!janosh->add(Record(*it), *(it + 1)))
-          return {0, "Failed"};
-      }
-
-      return {params.size()/2, "Successful"};
+      return {janosh->add(params.begin(), params.end()), "Successful"};
     }
   }
 };
@@ -173,13 +181,7 @@ public:
     if (params.empty() || params.size() % 2 != 0) {
       return {-1, "Expected a list of path/value pairs"};
     } else {
-
-      for (auto it = params.begin(); it != params.end(); it += 2) {
-        if (!janosh->replace(Record(*it), *(it + 1)))
-          return {0, "Failed"};
-      }
-
-      return {params.size()/2, "Successful"};
+      return {janosh->replace(params.begin(), params.end()), "Successful"};
     }
   }
 };
@@ -194,16 +196,7 @@ public:
     if (params.empty() || params.size() % 2 != 0) {
       return {-1, "Expected a list of path/value pairs"};
     } else {
-
-      size_t cnt = 0;
-      for (auto it = params.begin(); it != params.end(); it += 2) {
-        cnt += janosh->set(Record(*it), *(it + 1));
-      }
-
-      if (cnt < 0)
-        return {0, "Failed"};
-      else
-        return {cnt, "Successful"};
+      return {janosh->set(params.begin(), params.end()), "Successful"};
     }
   }
 };
@@ -362,19 +355,28 @@ public:
   }
 
   Result operator()(const vector<string>& params) {
-    if (params.empty()) {
+    // everything following "where" is a filter expression
+    vector<string>::const_iterator where = params.begin();
+    while (where != params.end() && *where != "where" && !boost::starts_with(*where, "where "))
+      ++where;
+
+    const vector<string> paths(params.begin(), where);
+    if (paths.empty()) {
       return {-1, "Expected a list of keys"};
-    } else {
-      bool found_all = true;
-      BOOST_FOREACH(const string& p, params) {
-        Record rec(p);
-        found_all = found_all && janosh->get(rec, std::cout);
-      }
+    }
 
-      if (!found_all)
-        return {-1, "Unknown keys encounted"};
+    boost::scoped_ptr<janosh::Filter> filter;
+    if (where != params.end()) {
+      string expression = where->substr(5);
+      for (++where; where != params.end(); ++where)
+        expression += ' ' + *where;
+      filter.reset(new janosh::Filter(expression));
     }
-    return {params.size(), "Successful"};
+
+    if (!janosh->get(paths, std::cout, filter.get()))
+      return {-1, "Unknown keys encounted"};
+
+    return {paths.size(), "Successful"};
   }
 };
 
@@ -398,6 +400,167 @@ public:
   }
 };
 
+class FollowCommand: public Command {
+public:
+  FollowCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.empty() || params.size() > 2) {
+      return {-1, "Expected a follower database file and an optional poll interval"};
+    } else {
+      size_t interval = 0;
+      if (params.size() == 2)
+        interval = boost::lexical_cast<size_t>(params.back());
+
+      size_t cnt = janosh->follow(params.front(), interval, std::cout);
+      return {cnt + 1, "Successful"};
+    }
+  }
+};
+
+class SnapshotCommand: public Command {
+public:
+  SnapshotCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() != 1) {
+      return {-1, "Expected a snapshot file"};
+    } else {
+      return {janosh->snapshot(params.front()), "Successful"};
+    }
+  }
+};
+
+class ExportCommand: public Command {
+public:
+  ExportCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() != 1) {
+      return {-1, "Expected an export file"};
+    } else {
+      return {janosh->exportFile(params.front()), "Successful"};
+    }
+  }
+};
+
+class ImportCommand: public Command {
+public:
+  ImportCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() != 1) {
+      return {-1, "Expected an import file"};
+    } else {
+      return {janosh->importFile(params.front()), "Successful"};
+    }
+  }
+};
+
+class IndexCommand: public Command {
+public:
+  IndexCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() == 1 && params[0] == "list") {
+      typedef std::pair<string, size_t> Entry;
+      const vector<Entry> indexes = Record::indexes.list();
+      BOOST_FOREACH(const Entry& e, indexes) {
+        std::cout << e.first << '\t' << e.second << endl;
+      }
+      return {indexes.size() + 1, "Successful"};
+    } else if (params.size() == 2 && params[0] == "create") {
+      return {Record::indexes.create(params[1]) + 1, "Successful"};
+    } else if (params.size() == 2 && params[0] == "drop") {
+      return {Record::indexes.drop(params[1]) + 1, "Successful"};
+    } else {
+      return {-1, "Expected create <pattern>, drop <pattern> or list"};
+    }
+  }
+};
+
+class LookupCommand: public Command {
+public:
+  LookupCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() != 2) {
+      return {-1, "Expected an index pattern and a value"};
+    } else {
+      const vector<string> members = Record::indexes.lookup(params[0], params[1]);
+      BOOST_FOREACH(const string& m, members) {
+        std::cout << Path(m).pretty() << endl;
+      }
+      return {members.size(), "Successful"};
+    }
+  }
+};
+
+class AggregateCommand: public Command {
+public:
+  AggregateCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() != 2) {
+      return {-1, "Expected an aggregate and a pattern"};
+    } else {
+      size_t n = janosh->aggregate(params[0], params[1], std::cout);
+      return {n, "Successful"};
+    }
+  }
+};
+
+class SyncCommand: public Command {
+public:
+  SyncCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (!params.empty())
+      return {0, "Sync doesn't take any arguments"};
+
+    return {janosh->sync(), "Successful"};
+  }
+};
+
+class DefragCommand: public Command {
+public:
+  DefragCommand(janosh::Janosh* janosh) :
+      Command(janosh) {
+  }
+
+  virtual Result operator()(const vector<string>& params) {
+    if (params.size() > 2) {
+      return {-1, "Expected an optional step count and pause"};
+    } else {
+      int64_t step = 1000;
+      size_t pause = 10;
+      if (params.size() > 0)
+        step = boost::lexical_cast<int64_t>(params[0]);
+      if (params.size() > 1)
+        pause = boost::lexical_cast<size_t>(params[1]);
+
+      janosh->defrag(step, pause);
+      return {1, "Successful"};
+    }
+  }
+};
+
 CommandMap makeCommandMap(Janosh* janosh) {
   CommandMap cm;
   cm.insert( { "load", new LoadCommand(janosh) });
@@ -418,6 +581,16 @@ CommandMap makeCommandMap(Janosh* janosh) {
   cm.insert( { "mkarr", new MakeArrayCommand(janosh) });
   cm.insert( { "mkobj", new MakeObjectCommand(janosh) });
   cm.insert( { "hash", new HashCommand(janosh) });
+  cm.insert( { "follow", new FollowCommand(janosh) });
+  cm.insert( { "snapshot", new SnapshotCommand(janosh) });
+  cm.insert( { "export", new ExportCommand(janosh) });
+  cm.insert( { "import", new ImportCommand(janosh) });
+  cm.insert( { "index", new IndexCommand(janosh) });
+  cm.insert( { "lookup", new LookupCommand(janosh) });
+  cm.insert( { "agg", new AggregateCommand(janosh) });
+  cm.insert( { "defrag", new DefragCommand(janosh) });
+  cm.insert( { "sync", new SyncCommand(janosh) });
+  cm.insert( { "migrate", new MigrateCommand(janosh) });
   return cm;
 }
 
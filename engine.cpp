@@ -0,0 +1,699 @@
+#include "engine.hpp"
+#include "snapshot.hpp"
+#include <fstream>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace janosh {
+  Engine* Engine::create(const string& name) {
+    if(name == "kyoto")
+      return new KyotoEngine();
+    else if(name == "memory")
+      return new MemoryEngine();
+    else if(name == "snapshot")
+      return new SnapshotEngine();
+
+    throw engine_exception() << string_info({"unknown storage engine", name});
+  }
+
+  static uint64_t millis() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  KyotoEngine::Cursor::Cursor(kc::DB::Cursor* cur, KyotoEngine& engine) :
+    cur(cur),
+    engine(engine) {
+  }
+
+  KyotoEngine::Cursor::~Cursor() {
+    delete cur;
+  }
+
+  bool KyotoEngine::Cursor::jump() {
+    return cur->jump();
+  }
+
+  bool KyotoEngine::Cursor::jump(const string& key) {
+    return cur->jump(key);
+  }
+
+  bool KyotoEngine::Cursor::jump_back(const string& key) {
+    return cur->jump_back(key);
+  }
+
+  bool KyotoEngine::Cursor::step() {
+    return cur->step();
+  }
+
+  bool KyotoEngine::Cursor::step_back() {
+    return cur->step_back();
+  }
+
+  bool KyotoEngine::Cursor::get_key(string* key, bool step) {
+    return cur->get_key(key, step);
+  }
+
+  bool KyotoEngine::Cursor::get_value(string* value, bool step) {
+    return cur->get_value(value, step);
+  }
+
+  bool KyotoEngine::Cursor::get(string* key, string* value, bool step) {
+    return cur->get(key, value, step);
+  }
+
+  bool KyotoEngine::Cursor::set_value_str(const string& value) {
+    return engine.written(cur->set_value_str(value));
+  }
+
+  bool KyotoEngine::Cursor::remove() {
+    return engine.written(cur->remove());
+  }
+
+  KyotoEngine::KyotoEngine() :
+    transaction(false),
+    tryLock(false),
+    unsynced(0),
+    lastSync(0) {
+  }
+
+  void KyotoEngine::tune(const Tuning& tuning) {
+    if(tuning.pageCache >= 0)
+      db.tune_page_cache(tuning.pageCache);
+    if(tuning.pageSize >= 0)
+      db.tune_page(tuning.pageSize);
+    if(tuning.alignment >= 0)
+      db.tune_alignment(tuning.alignment);
+    if(tuning.freeBlockPool >= 0)
+      db.tune_fbp(tuning.freeBlockPool);
+    if(tuning.buckets >= 0)
+      db.tune_buckets(tuning.buckets);
+    if(tuning.mapSize >= 0)
+      db.tune_map(tuning.mapSize);
+    if(tuning.defragUnit >= 0)
+      db.tune_defrag(tuning.defragUnit);
+    if(tuning.compression)
+      db.tune_options(kc::TreeDB::TCOMPRESS);
+  }
+
+  void KyotoEngine::setDurability(const Durability& durability) {
+    this->durability = durability;
+  }
+
+  bool KyotoEngine::open(const string& path, uint32_t mode) {
+    uint32_t kcmode = 0;
+    if(mode & OREADER)
+      kcmode |= kc::PolyDB::OREADER;
+    if(mode & OWRITER)
+      kcmode |= kc::PolyDB::OWRITER;
+    if(mode & OCREATE)
+      kcmode |= kc::PolyDB::OCREATE;
+    if(mode & OTRYLOCK)
+      kcmode |= kc::PolyDB::OTRYLOCK;
+    // every level keeps the write ahead log, so a crash never leaves a broken file. Only the sync is deferred.
+    if(mode & OAUTOTRAN)
+      kcmode |= kc::PolyDB::OAUTOTRAN;
+    if((mode & OWRITER) && durability.level == Durability::Sync)
+      kcmode |= kc::PolyDB::OAUTOSYNC;
+
+    unsynced = 0;
+    lastSync = millis();
+    tryLock = mode & OTRYLOCK;
+    return db.open(path, kcmode);
+  }
+
+  bool KyotoEngine::close() {
+    bool synced = true;
+    if(unsynced > 0)
+      synced = sync();
+
+    return db.close() && synced;
+  }
+
+  string KyotoEngine::error() {
+    return db.error().name();
+  }
+
+  Engine::Cursor* KyotoEngine::cursor() {
+    return new KyotoEngine::Cursor(db.cursor(), *this);
+  }
+
+  bool KyotoEngine::get(const string& key, string* value) {
+    return db.get(key, value);
+  }
+
+  bool KyotoEngine::set(const string& key, const string& value) {
+    return written(db.set(key, value));
+  }
+
+  bool KyotoEngine::add(const string& key, const string& value) {
+    return written(db.add(key, value));
+  }
+
+  bool KyotoEngine::replace(const string& key, const string& value) {
+    return written(db.replace(key, value));
+  }
+
+  bool KyotoEngine::remove(const string& key) {
+    return written(db.remove(key));
+  }
+
+  bool KyotoEngine::clear() {
+    return written(db.clear());
+  }
+
+  int64_t KyotoEngine::count() {
+    return db.count();
+  }
+
+  bool KyotoEngine::begin_transaction() {
+    transaction = db.begin_transaction(durability.level == Durability::Sync);
+    return transaction;
+  }
+
+  bool KyotoEngine::end_transaction(bool commit) {
+    transaction = false;
+    const bool done = db.end_transaction(commit);
+    return commit ? written(done) : done;
+  }
+
+  /**
+   * Writes all changes to the disk.
+   */
+  bool KyotoEngine::sync() {
+    unsynced = 0;
+    lastSync = millis();
+    return db.synchronize(true);
+  }
+
+  /**
+   * Counts a mutation, a committed transaction counts once, so group and buffered durability sync on close.
+   * With group durability syncs the database once enough mutations were written or enough time passed since the last sync.
+   * @param success the result of the mutation, passed through.
+   */
+  bool KyotoEngine::written(bool success) {
+    if(!success || transaction || (durability.level != Durability::Group && durability.level != Durability::Buffered))
+      return success;
+
+    ++unsynced;
+    if(durability.level == Durability::Group && (unsynced >= durability.ops || millis() - lastSync >= static_cast<uint64_t>(durability.interval))) {
+      if(!sync())
+        return false;
+    }
+    return success;
+  }
+
+  bool KyotoEngine::defrag(int64_t step) {
+    return db.defrag(step);
+  }
+
+  int64_t KyotoEngine::fragments() {
+    std::map<string, string> status;
+    if(!db.status(&status) || status.find("frgcnt") == status.end())
+      return 0;
+
+    return boost::lexical_cast<int64_t>(status["frgcnt"]);
+  }
+
+  bool KyotoEngine::locked() {
+    // a lock that can't be taken right away fails as a system error, a missing or broken file doesn't
+    return tryLock && db.error().code() == kc::BasicDB::Error::SYSTEM;
+  }
+
+  MemoryEngine::Cursor::Cursor(MemoryEngine& engine) :
+    engine(engine),
+    generation(engine.generation),
+    valid(false) {
+  }
+
+  /**
+   * Revalidates the iterator after erasures. Like a kyoto cursor, a cursor whose record
+   * was removed moves on to the next record.
+   */
+  bool MemoryEngine::Cursor::sync() {
+    if(!valid)
+      return false;
+
+    if(generation != engine.generation)
+      return seek(engine.map.lower_bound(key));
+
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::seek(Map::iterator i) {
+    if(i == engine.map.end()) {
+      valid = false;
+      return false;
+    }
+
+    it = i;
+    key = i->first;
+    generation = engine.generation;
+    valid = true;
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::jump() {
+    return seek(engine.map.begin());
+  }
+
+  bool MemoryEngine::Cursor::jump(const string& k) {
+    return seek(engine.map.lower_bound(k));
+  }
+
+  bool MemoryEngine::Cursor::jump_back(const string& k) {
+    Map::iterator i = engine.map.upper_bound(k);
+    if(i == engine.map.begin()) {
+      valid = false;
+      return false;
+    }
+    return seek(--i);
+  }
+
+  bool MemoryEngine::Cursor::step() {
+    if(!sync())
+      return false;
+
+    return seek(++it);
+  }
+
+  bool MemoryEngine::Cursor::step_back() {
+    if(!sync())
+      return false;
+
+    if(it == engine.map.begin()) {
+      valid = false;
+      return false;
+    }
+    return seek(--it);
+  }
+
+  bool MemoryEngine::Cursor::get_key(string* k, bool st) {
+    if(!sync())
+      return false;
+
+    *k = it->first;
+    if(st)
+      step();
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::get_value(string* v, bool st) {
+    if(!sync())
+      return false;
+
+    *v = it->second;
+    if(st)
+      step();
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::get(string* k, string* v, bool st) {
+    if(!sync())
+      return false;
+
+    *k = it->first;
+    *v = it->second;
+    if(st)
+      step();
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::set_value_str(const string& v) {
+    if(!sync())
+      return false;
+
+    engine.touch(it->first);
+    it->second = v;
+    return true;
+  }
+
+  bool MemoryEngine::Cursor::remove() {
+    if(!sync())
+      return false;
+
+    Map::iterator next = it;
+    ++next;
+    engine.touch(it->first);
+    engine.erase(it);
+    seek(next);
+    return true;
+  }
+
+  MemoryEngine::MemoryEngine() :
+    writer(false),
+    busy(false),
+    transaction(false),
+    cleared(false),
+    generation(0) {
+  }
+
+  MemoryEngine::~MemoryEngine() {
+    close();
+  }
+
+  bool MemoryEngine::open(const string& p, uint32_t mode) {
+    using namespace boost::interprocess;
+    this->path = p;
+    this->writer = mode & OWRITER;
+    this->busy = false;
+
+    if(path.empty())
+      return true;
+
+    if(!boost::filesystem::exists(path)) {
+      if(!(mode & OCREATE)) {
+        lastError = "no repository";
+        return false;
+      }
+      std::ofstream create(path.c_str());
+    }
+
+    try {
+      file_lock l(path.c_str());
+      lock.swap(l);
+
+      if(!writer) {
+        lock.lock_sharable();
+      } else if(mode & OTRYLOCK) {
+        if(!lock.try_lock()) {
+          lastError = "locked";
+          busy = true;
+          return false;
+        }
+      } else {
+        lock.lock();
+      }
+    } catch(interprocess_exception& ex) {
+      lastError = ex.what();
+      return false;
+    }
+
+    return load();
+  }
+
+  bool MemoryEngine::close() {
+    bool r = true;
+    if(!path.empty()) {
+      if(writer)
+        r = save();
+
+      boost::interprocess::file_lock released;
+      lock.swap(released);
+      path.clear();
+    }
+    map.clear();
+    ++generation;
+    return r;
+  }
+
+  string MemoryEngine::error() {
+    return lastError;
+  }
+
+  Engine::Cursor* MemoryEngine::cursor() {
+    return new MemoryEngine::Cursor(*this);
+  }
+
+  bool MemoryEngine::get(const string& key, string* value) {
+    Map::iterator it = map.find(key);
+    if(it == map.end()) {
+      lastError = "no record";
+      return false;
+    }
+
+    *value = it->second;
+    return true;
+  }
+
+  bool MemoryEngine::set(const string& key, const string& value) {
+    touch(key);
+    map[key] = value;
+    return true;
+  }
+
+  bool MemoryEngine::add(const string& key, const string& value) {
+    Map::iterator it = map.lower_bound(key);
+    if(it != map.end() && it->first == key) {
+      lastError = "record duplication";
+      return false;
+    }
+
+    touch(key);
+    map.insert(it, std::make_pair(key, value));
+    return true;
+  }
+
+  bool MemoryEngine::replace(const string& key, const string& value) {
+    Map::iterator it = map.find(key);
+    if(it == map.end()) {
+      lastError = "no record";
+      return false;
+    }
+
+    touch(key);
+    it->second = value;
+    return true;
+  }
+
+  bool MemoryEngine::remove(const string& key) {
+    Map::iterator it = map.find(key);
+    if(it == map.end()) {
+      lastError = "no record";
+      return false;
+    }
+
+    touch(key);
+    erase(it);
+    return true;
+  }
+
+  bool MemoryEngine::clear() {
+    if(transaction && !cleared) {
+      // keep the state from the beginning of the transaction for a rollback
+      cleared = true;
+      clearedMap.swap(map);
+      for(UndoLog::iterator it = undo.begin(); it != undo.end(); ++it) {
+        if(it->second.first)
+          clearedMap[it->first] = it->second.second;
+        else
+          clearedMap.erase(it->first);
+      }
+      undo.clear();
+    }
+
+    map.clear();
+    ++generation;
+    return true;
+  }
+
+  int64_t MemoryEngine::count() {
+    return map.size();
+  }
+
+  bool MemoryEngine::begin_transaction() {
+    if(transaction) {
+      lastError = "transaction already in progress";
+      return false;
+    }
+
+    transaction = true;
+    return true;
+  }
+
+  bool MemoryEngine::end_transaction(bool commit) {
+    if(!transaction) {
+      lastError = "no transaction in progress";
+      return false;
+    }
+
+    if(!commit) {
+      if(cleared) {
+        map.swap(clearedMap);
+      } else {
+        for(UndoLog::iterator it = undo.begin(); it != undo.end(); ++it) {
+          if(it->second.first)
+            map[it->first] = it->second.second;
+          else
+            map.erase(it->first);
+        }
+      }
+      ++generation;
+    }
+
+    transaction = false;
+    cleared = false;
+    clearedMap.clear();
+    undo.clear();
+    return true;
+  }
+
+  bool MemoryEngine::locked() {
+    return busy;
+  }
+
+  void MemoryEngine::touch(const string& key) {
+    if(!transaction || cleared || undo.find(key) != undo.end())
+      return;
+
+    Map::iterator it = map.find(key);
+    if(it == map.end())
+      undo[key] = std::make_pair(false, string());
+    else
+      undo[key] = std::make_pair(true, it->second);
+  }
+
+  void MemoryEngine::erase(Map::iterator it) {
+    map.erase(it);
+    ++generation;
+  }
+
+  /**
+   * File layout: a sequence of (uint32 key size, key, uint32 value size, value) in key order.
+   */
+  bool MemoryEngine::load() {
+    std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+    const uintmax_t fileSize = boost::filesystem::file_size(path);
+    uint32_t ksize, vsize;
+    string key, value;
+
+    map.clear();
+    while(is.read(reinterpret_cast<char*>(&ksize), sizeof(ksize))) {
+      if(ksize > fileSize) {
+        lastError = "broken file";
+        return false;
+      }
+
+      key.resize(ksize);
+      if(!is.read(&key[0], ksize) || !is.read(reinterpret_cast<char*>(&vsize), sizeof(vsize)) || vsize > fileSize) {
+        lastError = "broken file";
+        return false;
+      }
+
+      value.resize(vsize);
+      if(!is.read(&value[0], vsize)) {
+        lastError = "broken file";
+        return false;
+      }
+      map.insert(map.end(), std::make_pair(key, value));
+    }
+    ++generation;
+    return true;
+  }
+
+  bool MemoryEngine::save() {
+    std::ofstream os(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    for(Map::const_iterator it = map.begin(); it != map.end(); ++it) {
+      const uint32_t ksize = it->first.size();
+      const uint32_t vsize = it->second.size();
+      os.write(reinterpret_cast<const char*>(&ksize), sizeof(ksize));
+      os.write(it->first.data(), ksize);
+      os.write(reinterpret_cast<const char*>(&vsize), sizeof(vsize));
+      os.write(it->second.data(), vsize);
+    }
+
+    if(!os.good()) {
+      lastError = "write error";
+      return false;
+    }
+    return true;
+  }
+
+  size_t Transaction::depth = 0;
+  bool Transaction::aborted = false;
+
+  Transaction::Transaction(Engine& engine) :
+    engine(engine),
+    outermost(depth == 0),
+    committed(false) {
+    if(outermost) {
+      if(!engine.begin_transaction())
+        throw engine_exception() << string_info({"failed to begin transaction", engine.error()});
+      aborted = false;
+    }
+    ++depth;
+  }
+
+  Transaction::~Transaction() {
+    --depth;
+    if(committed)
+      return;
+
+    if(outermost) {
+      engine.end_transaction(false);
+      finish(false);
+    } else {
+      aborted = true;
+    }
+  }
+
+  void Transaction::commit() {
+    if(committed)
+      return;
+
+    committed = true;
+    if(!outermost)
+      return;
+
+    if(aborted) {
+      engine.end_transaction(false);
+      finish(false);
+      throw engine_exception() << string_info({"transaction aborted", "a nested operation did not complete"});
+    }
+
+    try {
+      for(const Preparer& p : preparers())
+        p();
+    } catch(...) {
+      engine.end_transaction(false);
+      finish(false);
+      throw;
+    }
+
+    if(!engine.end_transaction(true)) {
+      finish(false);
+      throw engine_exception() << string_info({"failed to commit transaction", engine.error()});
+    }
+    finish(true);
+  }
+
+  /**
+   * @return true while a transaction scope is open.
+   */
+  bool Transaction::active() {
+    return depth > 0;
+  }
+
+  /**
+   * Registers a function that is called before the outermost scope commits.
+   * It throws to abort the transaction.
+   */
+  void Transaction::prepare(const Preparer& preparer) {
+    preparers().push_back(preparer);
+  }
+
+  /**
+   * Registers a function that is called with true after the outermost scope committed
+   * and with false after it aborted.
+   */
+  void Transaction::listen(const Listener& listener) {
+    listeners().push_back(listener);
+  }
+
+  std::vector<Transaction::Preparer>& Transaction::preparers() {
+    static std::vector<Preparer> registered;
+    return registered;
+  }
+
+  std::vector<Transaction::Listener>& Transaction::listeners() {
+    // function local, so listeners can register during static initialization
+    static std::vector<Listener> registered;
+    return registered;
+  }
+
+  void Transaction::finish(bool commit) {
+    for(const Listener& l : listeners())
+      l(commit);
+  }
+}
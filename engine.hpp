@@ -0,0 +1,310 @@
+#ifndef _JANOSH_ENGINE_HPP
+#define _JANOSH_ENGINE_HPP
+
+#include <map>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <boost/function.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <kcpolydb.h>
+
+#include "logger.hpp"
+#include "exception.hpp"
+
+namespace janosh {
+  namespace kc = kyotocabinet;
+  using std::string;
+
+  /**
+   * Storage tuning parameters. Negative values keep the engine defaults.
+   * Alignment, free block pool, buckets, page size and compression only take effect
+   * when a database file is created. The others apply on every open.
+   */
+  struct Tuning {
+    int64_t pageCache;
+    int64_t pageSize;
+    int64_t alignment;
+    int64_t freeBlockPool;
+    int64_t buckets;
+    int64_t mapSize;
+    int64_t defragUnit;
+    bool compression;
+
+    Tuning() :
+      pageCache(-1), pageSize(-1), alignment(-1), freeBlockPool(-1),
+      buckets(-1), mapSize(-1), defragUnit(-1), compression(false) {
+    }
+  };
+
+  /**
+   * How writes reach the disk.
+   *   atomic:   every mutation is its own engine transaction. The default.
+   *   sync:     like atomic, and every mutation and transaction is synced to the disk.
+   *   group:    like atomic, but the database is synced only when a write finds that interval milliseconds
+   *             passed or ops mutations were written since the last sync. There is no timer, an idle process
+   *             holds its last writes unsynced until it closes the database, which syncs once more.
+   *   buffered: like atomic, but the database is synced only on close or by an explicit sync.
+   * Every level keeps the write ahead log of the engine, so a crash doesn't break the database file.
+   * An operating system crash or power loss may lose the writes since the last sync with atomic, group and buffered.
+   */
+  struct Durability {
+    enum Level {
+      Atomic, Sync, Group, Buffered
+    };
+
+    Level level;
+    int64_t interval;
+    int64_t ops;
+
+    Durability() :
+      level(Atomic), interval(200), ops(1000) {
+    }
+  };
+
+  /**
+   * Abstract ordered key value store. Keys are compared bytewise.
+   * Cursors stay usable while the store is modified through other cursors.
+   */
+  class Engine {
+  public:
+    enum OpenMode {
+      OREADER = 1 << 0,
+      OWRITER = 1 << 1,
+      OCREATE = 1 << 2,
+      OTRYLOCK = 1 << 3,
+      OAUTOTRAN = 1 << 4
+    };
+
+    class Cursor {
+    public:
+      virtual ~Cursor() {}
+
+      virtual bool jump() = 0;
+      virtual bool jump(const string& key) = 0;
+      virtual bool jump_back(const string& key) = 0;
+      virtual bool step() = 0;
+      virtual bool step_back() = 0;
+
+      virtual bool get_key(string* key, bool step = false) = 0;
+      virtual bool get_value(string* value, bool step = false) = 0;
+      virtual bool get(string* key, string* value, bool step = false) = 0;
+      virtual bool set_value_str(const string& value) = 0;
+      virtual bool remove() = 0;
+    };
+
+    virtual ~Engine() {}
+
+    virtual void tune(const Tuning& tuning) {}
+    virtual void setDurability(const Durability& durability) {}
+    virtual bool open(const string& path, uint32_t mode) = 0;
+    virtual bool close() = 0;
+    virtual string error() = 0;
+    virtual Cursor* cursor() = 0;
+
+    virtual bool get(const string& key, string* value) = 0;
+    virtual bool set(const string& key, const string& value) = 0;
+    virtual bool add(const string& key, const string& value) = 0;
+    virtual bool replace(const string& key, const string& value) = 0;
+    virtual bool remove(const string& key) = 0;
+    virtual bool clear() = 0;
+    virtual int64_t count() = 0;
+
+    virtual bool begin_transaction() = 0;
+    virtual bool end_transaction(bool commit = true) = 0;
+
+    virtual bool sync() {
+      return true;
+    }
+
+    virtual bool defrag(int64_t step) {
+      return true;
+    }
+
+    virtual int64_t fragments() {
+      return 0;
+    }
+
+    /**
+     * @return true if the last open failed because another process holds the lock of the database,
+     * which is worth retrying. Any other failure of open is permanent.
+     */
+    virtual bool locked() {
+      return false;
+    }
+
+    static Engine* create(const string& name);
+  };
+
+  /**
+   * The default engine. A Kyoto Cabinet TreeDB file.
+   */
+  class KyotoEngine : public Engine {
+  public:
+    class Cursor : public Engine::Cursor {
+      kc::DB::Cursor* cur;
+      KyotoEngine& engine;
+    public:
+      Cursor(kc::DB::Cursor* cur, KyotoEngine& engine);
+      virtual ~Cursor();
+
+      virtual bool jump();
+      virtual bool jump(const string& key);
+      virtual bool jump_back(const string& key);
+      virtual bool step();
+      virtual bool step_back();
+
+      virtual bool get_key(string* key, bool step = false);
+      virtual bool get_value(string* value, bool step = false);
+      virtual bool get(string* key, string* value, bool step = false);
+      virtual bool set_value_str(const string& value);
+      virtual bool remove();
+    };
+
+    KyotoEngine();
+
+    virtual void tune(const Tuning& tuning);
+    virtual void setDurability(const Durability& durability);
+    virtual bool open(const string& path, uint32_t mode);
+    virtual bool close();
+    virtual string error();
+    virtual Engine::Cursor* cursor();
+
+    virtual bool get(const string& key, string* value);
+    virtual bool set(const string& key, const string& value);
+    virtual bool add(const string& key, const string& value);
+    virtual bool replace(const string& key, const string& value);
+    virtual bool remove(const string& key);
+    virtual bool clear();
+    virtual int64_t count();
+
+    virtual bool begin_transaction();
+    virtual bool end_transaction(bool commit = true);
+
+    virtual bool sync();
+    virtual bool defrag(int64_t step);
+    virtual int64_t fragments();
+    virtual bool locked();
+  private:
+    kc::TreeDB db;
+    Durability durability;
+    bool transaction;
+    bool tryLock;
+    int64_t unsynced;
+    uint64_t lastSync;
+
+    bool written(bool success);
+  };
+
+  /**
+   * A sorted map held in memory. Useful to tell janosh's own cost from storage cost.
+   * If opened with a path the map is loaded from that file and written back on close
+   * when opened as writer. The file is guarded by an advisory lock.
+   */
+  class MemoryEngine : public Engine {
+    typedef std::map<string, string> Map;
+
+    // pairs of (existed before, old value) recorded on first touch inside a transaction
+    typedef std::map<string, std::pair<bool, string> > UndoLog;
+  public:
+    class Cursor : public Engine::Cursor {
+      MemoryEngine& engine;
+      Map::iterator it;
+      string key;
+      size_t generation;
+      bool valid;
+
+      bool sync();
+      bool seek(Map::iterator i);
+    public:
+      Cursor(MemoryEngine& engine);
+
+      virtual bool jump();
+      virtual bool jump(const string& key);
+      virtual bool jump_back(const string& key);
+      virtual bool step();
+      virtual bool step_back();
+
+      virtual bool get_key(string* key, bool step = false);
+      virtual bool get_value(string* value, bool step = false);
+      virtual bool get(string* key, string* value, bool step = false);
+      virtual bool set_value_str(const string& value);
+      virtual bool remove();
+    };
+
+    MemoryEngine();
+    virtual ~MemoryEngine();
+
+    virtual bool open(const string& path, uint32_t mode);
+    virtual bool close();
+    virtual string error();
+    virtual Engine::Cursor* cursor();
+
+    virtual bool get(const string& key, string* value);
+    virtual bool set(const string& key, const string& value);
+    virtual bool add(const string& key, const string& value);
+    virtual bool replace(const string& key, const string& value);
+    virtual bool remove(const string& key);
+    virtual bool clear();
+    virtual int64_t count();
+
+    virtual bool begin_transaction();
+    virtual bool end_transaction(bool commit = true);
+    virtual bool locked();
+  private:
+    Map map;
+    string path;
+    string lastError;
+    bool writer;
+    bool busy;
+    bool transaction;
+    bool cleared;
+    Map clearedMap;
+    UndoLog undo;
+    // bumped whenever an element is erased so cursors know their iterator may be stale
+    size_t generation;
+    boost::interprocess::file_lock lock;
+
+    void touch(const string& key);
+    void erase(Map::iterator it);
+    bool load();
+    bool save();
+  };
+
+  struct engine_exception : virtual janosh_exception { };
+
+  /**
+   * Scoped transaction on an engine.
+   * A scope opened while another one is active joins the outer transaction.
+   * The outermost scope commits on commit() and aborts if it is left without committing,
+   * also if a joined scope was left without committing.
+   * Preparers run before the engine commits the outermost scope, the transaction aborts if one of them throws.
+   * Listeners are told whether the outermost scope committed or aborted, after the engine finished it.
+   */
+  class Transaction {
+  public:
+    typedef boost::function<void()> Preparer;
+    typedef boost::function<void(bool)> Listener;
+
+    Transaction(Engine& engine);
+    ~Transaction();
+    void commit();
+
+    static bool active();
+    static void prepare(const Preparer& preparer);
+    static void listen(const Listener& listener);
+  private:
+    Engine& engine;
+    bool outermost;
+    bool committed;
+
+    static size_t depth;
+    static bool aborted;
+
+    static std::vector<Preparer>& preparers();
+    static std::vector<Listener>& listeners();
+    static void finish(bool commit);
+  };
+}
+
+#endif
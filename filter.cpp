@@ -0,0 +1,194 @@
+#include "filter.hpp"
+#include "record.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <boost/algorithm/string/replace.hpp>
+
+namespace janosh {
+  struct Token {
+    string text;
+    bool quoted;
+  };
+
+  static bool isOperatorChar(const char c) {
+    return c == '=' || c == '!' || c == '<' || c == '>';
+  }
+
+  static vector<Token> tokenize(const string& expression) {
+    vector<Token> tokens;
+    size_t i = 0;
+    while (i < expression.size()) {
+      const char c = expression[i];
+      if (isspace(c)) {
+        ++i;
+      } else if (c == '"') {
+        Token t = { "", true };
+        for (++i; i < expression.size() && expression[i] != '"'; ++i) {
+          if (expression[i] == '\\' && i + 1 < expression.size())
+            ++i;
+          t.text.push_back(expression[i]);
+        }
+
+        if (i == expression.size())
+          throw filter_exception() << string_info({"unterminated string", expression});
+        ++i;
+        tokens.push_back(t);
+      } else {
+        const size_t start = i;
+        const bool op = isOperatorChar(c);
+        while (i < expression.size() && !isspace(expression[i]) && expression[i] != '"' && isOperatorChar(expression[i]) == op)
+          ++i;
+        tokens.push_back({ expression.substr(start, i - start), false });
+      }
+    }
+    return tokens;
+  }
+
+  /**
+   * Translates a field like ".a.#0" into the key suffix of the field below a member.
+   */
+  static string fieldSuffix(const string& field) {
+    if (field.empty() || field[0] != '.')
+      throw filter_exception() << string_info({"expected a field", field});
+
+    if (field.size() == 1)
+      return "";
+
+    return Path(boost::algorithm::replace_all_copy(field, ".", "/")).key();
+  }
+
+  /**
+   * Compiles a filter expression.
+   * @param expression the expression, see Filter.
+   */
+  Filter::Filter(const string& expression) {
+    const vector<Token> tokens = tokenize(expression);
+    if (tokens.empty())
+      throw filter_exception() << string_info({"empty filter", expression});
+
+    alternatives.push_back(vector<Condition>());
+    size_t i = 0;
+    while (true) {
+      Condition c;
+      c.suffix = fieldSuffix(tokens[i].text);
+      c.op = Exists;
+      c.literal = Keyword;
+      c.number = 0;
+      ++i;
+
+      if (i < tokens.size() && !tokens[i].quoted && isOperatorChar(tokens[i].text[0])) {
+        const string& op = tokens[i].text;
+        if (op == "==")
+          c.op = Eq;
+        else if (op == "!=")
+          c.op = Ne;
+        else if (op == "<")
+          c.op = Lt;
+        else if (op == "<=")
+          c.op = Le;
+        else if (op == ">")
+          c.op = Gt;
+        else if (op == ">=")
+          c.op = Ge;
+        else
+          throw filter_exception() << string_info({"unknown operator", op});
+
+        if (++i == tokens.size())
+          throw filter_exception() << string_info({"expected a value", expression});
+
+        const Token& value = tokens[i++];
+        c.text = value.text;
+        char* end;
+        c.number = strtod(value.text.c_str(), &end);
+        if (value.quoted)
+          c.literal = Text;
+        else if (!value.text.empty() && *end == '\0')
+          c.literal = Number;
+        else if (value.text == "true" || value.text == "false" || value.text == "null")
+          c.literal = Keyword;
+        else
+          c.literal = Text;
+      }
+
+      alternatives.back().push_back(c);
+
+      if (i == tokens.size())
+        break;
+
+      if (tokens[i].text == "or")
+        alternatives.push_back(vector<Condition>());
+      else if (tokens[i].text != "and")
+        throw filter_exception() << string_info({"expected and/or", tokens[i].text});
+
+      if (++i == tokens.size())
+        throw filter_exception() << string_info({"expected a condition", expression});
+    }
+  }
+
+  bool Filter::test(const Condition& c, const string& memberKey) const {
+    string raw;
+    if (!Record::db->get(memberKey + c.suffix, &raw))
+      return c.op == Ne;
+
+    if (c.op == Exists)
+      return true;
+
+    const Value v(raw, false);
+    int cmp;
+    if (c.literal == Number) {
+      // strings written from the command line or by older versions are compared by their numeric value
+      double d = 0;
+      char* end = NULL;
+      if (v.isNumber())
+        d = v.getReal();
+      else if (v.getType() == Value::String && !v.str().empty())
+        d = strtod(v.str().c_str(), &end);
+
+      if (!v.isNumber() && (end == NULL || *end != '\0'))
+        return c.op == Ne;
+      cmp = d < c.number ? -1 : (d > c.number ? 1 : 0);
+    } else if (c.literal == Keyword) {
+      // like numbers, keywords written from the command line are stored as strings and match by their text
+      if (v.isNumber())
+        return c.op == Ne;
+      cmp = v.str() == c.text ? 0 : 1;
+      if (cmp != 0 && c.op != Eq && c.op != Ne)
+        return false;
+    } else {
+      if (v.getType() != Value::String)
+        return c.op == Ne;
+      cmp = v.str().compare(c.text);
+    }
+
+    switch (c.op) {
+      case Eq: return cmp == 0;
+      case Ne: return cmp != 0;
+      case Lt: return cmp < 0;
+      case Le: return cmp <= 0;
+      case Gt: return cmp > 0;
+      case Ge: return cmp >= 0;
+      default: return false;
+    }
+  }
+
+  /**
+   * Evaluates the filter for one directory member.
+   * @param memberKey the key of the member without a trailing directory marker.
+   * @return true if any alternative has all its conditions met.
+   */
+  bool Filter::matches(const string& memberKey) const {
+    for (const vector<Condition>& conditions : alternatives) {
+      bool all = true;
+      for (const Condition& c : conditions) {
+        if (!test(c, memberKey)) {
+          all = false;
+          break;
+        }
+      }
+
+      if (all)
+        return true;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef _JANOSH_FILTER_HPP
+#define _JANOSH_FILTER_HPP
+
+#include <string>
+#include <vector>
+
+#include "logger.hpp"
+#include "exception.hpp"
+
+namespace janosh {
+  using std::string;
+  using std::vector;
+
+  /**
+   * A predicate over the fields of directory members, compiled once from an expression like
+   *   .votes > 3 and .type == "video" or .pinned == true
+   * Fields are relative member paths (".a.b", ".list.#0"). A field alone tests for existence.
+   * Operators are ==, !=, <, <=, >, >=. "and" binds tighter than "or", there are no parentheses.
+   * Literals are numbers, quoted or bare strings, true, false and null.
+   * Numbers compare with numeric values and with strings holding a number,
+   * true, false and null with the same values and with strings holding the same text.
+   * A comparison with a missing field or a field of an incomparable type is false, except for !=.
+   */
+  class Filter {
+  public:
+    Filter(const string& expression);
+
+    bool matches(const string& memberKey) const;
+  private:
+    enum Op {
+      Exists, Eq, Ne, Lt, Le, Gt, Ge
+    };
+
+    enum Literal {
+      Number, Text, Keyword
+    };
+
+    struct Condition {
+      string suffix;
+      Op op;
+      Literal literal;
+      string text;
+      double number;
+    };
+
+    vector<vector<Condition> > alternatives;
+
+    bool test(const Condition& c, const string& memberKey) const;
+  };
+
+  struct filter_exception : virtual janosh_exception { };
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "index.hpp"
+#include "path.hpp"
+#include "value.hpp"
+#include <boost/scoped_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace janosh {
+  static const string definitionPrefix = "!index:";
+  static const string entryPrefix = "!index/";
+  static const string reversePrefix = "!index~";
+
+  /**
+   * Collects all keys starting with a prefix.
+   */
+  static vector<string> keysWithPrefix(Engine& db, const string& prefix) {
+    boost::scoped_ptr<Engine::Cursor> cur(db.cursor());
+    vector<string> keys;
+    string key;
+    if(!cur->jump(prefix))
+      return keys;
+
+    while(cur->get_key(&key, true) && key.compare(0, prefix.size(), prefix) == 0)
+      keys.push_back(key);
+    return keys;
+  }
+
+  IndexSet::IndexSet() :
+    db(NULL),
+    log(NULL),
+    counters({0, 0, 0}) {
+  }
+
+  /**
+   * Loads the index definitions of a database.
+   * @param db the database.
+   * @param log the update log index changes are written to.
+   */
+  void IndexSet::open(Engine& db, UpdateLog& log) {
+    this->db = &db;
+    this->log = &log;
+    this->definitions.clear();
+
+    boost::scoped_ptr<Engine::Cursor> cur(db.cursor());
+    string key, prefix;
+    if(!cur->jump(definitionPrefix))
+      return;
+
+    while(cur->get(&key, &prefix, true) && key.compare(0, definitionPrefix.size(), definitionPrefix) == 0) {
+      const string pattern = key.substr(definitionPrefix.size());
+      definitions.push_back({pattern, prefix, pattern.substr(prefix.size() + 1)});
+    }
+  }
+
+  bool IndexSet::empty() const {
+    return definitions.empty();
+  }
+
+  const IndexSet::Stats& IndexSet::stats() const {
+    return counters;
+  }
+
+  /**
+   * Splits a pattern like /queue/ * /id (without the blanks) at its wildcard.
+   */
+  IndexSet::Definition IndexSet::parse(const string& pattern) {
+    const size_t pos = pattern.find("/*");
+    if(pos == string::npos || (pos + 2 < pattern.size() && pattern[pos + 2] != '/') || pattern.find('*', pos + 2) != string::npos)
+      throw index_exception() << string_info({"expected one wildcard member in index pattern", pattern});
+
+    const string dir = pattern.substr(0, pos);
+    const string field = pattern.substr(pos + 2);
+
+    Definition def;
+    def.prefix = (dir.empty() ? "" : Path(dir).key()) + '/';
+    def.suffix = field.empty() ? "" : Path(field).key();
+    def.pattern = def.prefix + '*' + def.suffix;
+    return def;
+  }
+
+  /**
+   * Tests if a key is the indexed field of a member.
+   * @param memberKey receives the key of the member.
+   */
+  bool IndexSet::member(const Definition& def, const string& key, string& memberKey) {
+    const size_t p = def.prefix.size();
+    if(key.size() <= p || key.compare(0, p, def.prefix) != 0 || key[p] == '!')
+      return false;
+
+    const size_t end = key.find('/', p);
+    if(end == string::npos) {
+      memberKey = key;
+      return def.suffix.empty();
+    }
+
+    memberKey = key.substr(0, end);
+    return key.compare(end, string::npos, def.suffix) == 0;
+  }
+
+  const IndexSet::Definition* IndexSet::find(const string& pattern) const {
+    for(const Definition& def : definitions) {
+      if(def.pattern == pattern)
+        return &def;
+    }
+    return NULL;
+  }
+
+  void IndexSet::put(const string& key, const string& value) {
+    if(!db->set(key, value))
+      throw index_exception() << string_info({"failed to write index", db->error()});
+    log->set(key, value);
+    ++counters.updates;
+  }
+
+  void IndexSet::erase(const string& key) {
+    if(!db->remove(key))
+      throw index_exception() << string_info({"failed to remove index entry", db->error()});
+    log->remove(key);
+    ++counters.updates;
+  }
+
+  void IndexSet::add(const Definition& def, const string& memberKey, const string& text) {
+    put(entryPrefix + def.pattern + '\0' + text + '\0' + memberKey, "");
+    put(reversePrefix + def.pattern + '\0' + memberKey, text);
+  }
+
+  void IndexSet::unlink(const Definition& def, const string& memberKey) {
+    const string reverse = reversePrefix + def.pattern + '\0' + memberKey;
+    string text;
+    if(!db->get(reverse, &text))
+      return;
+
+    erase(entryPrefix + def.pattern + '\0' + text + '\0' + memberKey);
+    erase(reverse);
+  }
+
+  /**
+   * Declares an index and builds it from the current content in one transaction.
+   * @param pattern the indexed field, like /queue/ * /id (without the blanks).
+   * @return number of indexed members.
+   */
+  size_t IndexSet::create(const string& pattern) {
+    const Definition def = parse(pattern);
+    if(find(def.pattern))
+      throw index_exception() << string_info({"index exists", pattern});
+
+    vector<std::pair<string, string> > fields;
+    {
+      boost::scoped_ptr<Engine::Cursor> cur(db->cursor());
+      string key, value, memberKey;
+      if(cur->jump(def.prefix)) {
+        while(cur->get(&key, &value, true) && key.compare(0, def.prefix.size(), def.prefix) == 0) {
+          if(member(def, key, memberKey))
+            fields.push_back({memberKey, Value(value, false).str()});
+        }
+      }
+    }
+
+    Transaction txn(*db);
+    put(definitionPrefix + def.pattern, def.prefix);
+    for(const std::pair<string, string>& f : fields)
+      add(def, f.first, f.second);
+    txn.commit();
+
+    definitions.push_back(def);
+    return fields.size();
+  }
+
+  /**
+   * Removes an index with all its entries in one transaction.
+   * @return number of removed entries.
+   */
+  size_t IndexSet::drop(const string& pattern) {
+    const Definition def = parse(pattern);
+    if(!find(def.pattern))
+      throw index_exception() << string_info({"no such index", pattern});
+
+    const vector<string> entries = keysWithPrefix(*db, entryPrefix + def.pattern + '\0');
+    const vector<string> reverse = keysWithPrefix(*db, reversePrefix + def.pattern + '\0');
+
+    Transaction txn(*db);
+    for(const string& key : entries)
+      erase(key);
+    for(const string& key : reverse)
+      erase(key);
+    erase(definitionPrefix + def.pattern);
+    txn.commit();
+
+    for(vector<Definition>::iterator it = definitions.begin(); it != definitions.end(); ++it) {
+      if(it->pattern == def.pattern) {
+        definitions.erase(it);
+        break;
+      }
+    }
+    return entries.size();
+  }
+
+  /**
+   * @return the pattern and the number of indexed members of every index.
+   */
+  vector<std::pair<string, size_t> > IndexSet::list() {
+    vector<std::pair<string, size_t> > result;
+    for(const Definition& def : definitions) {
+      const string dir = def.prefix.substr(0, def.prefix.size() - 1);
+      const string pretty = (dir.empty() ? "" : Path(dir).pretty()) + "/*" + (def.suffix.empty() ? "" : Path(def.suffix).pretty());
+      result.push_back({pretty, keysWithPrefix(*db, reversePrefix + def.pattern + '\0').size()});
+    }
+    return result;
+  }
+
+  /**
+   * Finds the members whose indexed field has the given text.
+   * @param pattern the indexed field.
+   * @param value the text of the field value.
+   * @return the keys of the members in key order.
+   */
+  vector<string> IndexSet::lookup(const string& pattern, const string& value) {
+    const Definition def = parse(pattern);
+    if(!find(def.pattern))
+      throw index_exception() << string_info({"no such index", pattern});
+
+    const string prefix = entryPrefix + def.pattern + '\0' + value + '\0';
+    vector<string> members = keysWithPrefix(*db, prefix);
+    for(string& key : members)
+      key.erase(0, prefix.size());
+    return members;
+  }
+
+  /**
+   * Updates the indexes covering a key that was set.
+   */
+  void IndexSet::set(const string& key, const string& value) {
+    if(definitions.empty() || key.empty() || key[0] != '/')
+      return;
+
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    string memberKey;
+    bool hit = false;
+    for(const Definition& def : definitions) {
+      if(!member(def, key, memberKey))
+        continue;
+
+      unlink(def, memberKey);
+      add(def, memberKey, Value(value, false).str());
+      hit = true;
+    }
+
+    if(hit) {
+      ++counters.writes;
+      counters.micros += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+    }
+  }
+
+  /**
+   * Updates the indexes covering a key that was removed.
+   */
+  void IndexSet::remove(const string& key) {
+    if(definitions.empty() || key.empty() || key[0] != '/')
+      return;
+
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    string memberKey;
+    bool hit = false;
+    for(const Definition& def : definitions) {
+      if(!member(def, key, memberKey))
+        continue;
+
+      unlink(def, memberKey);
+      hit = true;
+    }
+
+    if(hit) {
+      ++counters.writes;
+      counters.micros += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+    }
+  }
+
+  /**
+   * Forgets all definitions after the database was cleared.
+   */
+  void IndexSet::clear() {
+    definitions.clear();
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef _JANOSH_INDEX_HPP
+#define _JANOSH_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "logger.hpp"
+#include "exception.hpp"
+#include "engine.hpp"
+#include "updatelog.hpp"
+
+namespace janosh {
+  using std::string;
+  using std::vector;
+
+  /**
+   * Secondary indexes on a field of the members of a directory, declared by a pattern like /queue/ * /id
+   * (without the blanks). The index maps the text of the field value to the keys of the members holding it.
+   * Indexes live in the same database under keys that sort before the document tree:
+   *   definition: "!index:" pattern                                  -> ""
+   *   entry:      "!index/" pattern '\0' field text '\0' member key   -> ""
+   *   reverse:    "!index~" pattern '\0' member key                  -> field text
+   * The pattern is stored with its components in key form. The reverse entry finds the stale entry when a field changes.
+   * Every key level mutation of the database is passed to set() or remove() within the transaction of the mutation.
+   */
+  class IndexSet {
+  public:
+    struct Stats {
+      uint64_t writes;
+      uint64_t updates;
+      uint64_t micros;
+    };
+
+    IndexSet();
+
+    void open(Engine& db, UpdateLog& log);
+    bool empty() const;
+    const Stats& stats() const;
+
+    size_t create(const string& pattern);
+    size_t drop(const string& pattern);
+    vector<std::pair<string, size_t> > list();
+    vector<string> lookup(const string& pattern, const string& value);
+
+    void set(const string& key, const string& value);
+    void remove(const string& key);
+    void clear();
+  private:
+    struct Definition {
+      string pattern;
+      string prefix;
+      string suffix;
+    };
+
+    Engine* db;
+    UpdateLog* log;
+    vector<Definition> definitions;
+    Stats counters;
+
+    static Definition parse(const string& pattern);
+    static bool member(const Definition& def, const string& key, string& memberKey);
+    const Definition* find(const string& pattern) const;
+    void add(const Definition& def, const string& memberKey, const string& text);
+    void unlink(const Definition& def, const string& memberKey);
+    void put(const string& key, const string& value);
+    void erase(const string& key);
+  };
+
+  struct index_exception : virtual janosh_exception { };
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "janosh.hpp"
 #include "commands.hpp"
+#include <getopt.h>
 
 using std::string;
 using std::map;
@@ -114,7 +115,9 @@ namespace janosh {
   }
 
 
-  Settings::Settings() {
+  Settings::Settings() :
+    engine("kyoto"),
+    cacheBudget(0) {
     const char* home = getenv ("HOME");
     if (home==NULL) {
       error("Can't find environment variable.", "HOME");
@@ -155,6 +158,66 @@ namespace janosh {
 
           error(this->janoshFile.string(), "No database file defined");
         }
+
+        if(find(jObj, "engine", v)) {
+          this->engine = v.get_str();
+          if(this->engine != "kyoto" && this->engine != "memory")
+            error("Unknown storage engine", this->engine);
+        }
+
+        if(find(jObj, "tuning", v)) {
+          const js::Object& tObj = v.get_obj();
+          js::Value t;
+          if(find(tObj, "pageCache", t))
+            tuning.pageCache = t.get_int64();
+          if(find(tObj, "pageSize", t))
+            tuning.pageSize = t.get_int64();
+          if(find(tObj, "alignment", t))
+            tuning.alignment = t.get_int64();
+          if(find(tObj, "freeBlockPool", t))
+            tuning.freeBlockPool = t.get_int64();
+          if(find(tObj, "buckets", t))
+            tuning.buckets = t.get_int64();
+          if(find(tObj, "mapSize", t))
+            tuning.mapSize = t.get_int64();
+          if(find(tObj, "defragUnit", t))
+            tuning.defragUnit = t.get_int64();
+          if(find(tObj, "compression", t))
+            tuning.compression = t.get_bool();
+        }
+
+        if(find(jObj, "durability", v)) {
+          const js::Object& dObj = v.get_obj();
+          js::Value d;
+          if(find(dObj, "level", d)) {
+            const string level = d.get_str();
+            if(level == "atomic")
+              durability.level = Durability::Atomic;
+            else if(level == "sync")
+              durability.level = Durability::Sync;
+            else if(level == "group")
+              durability.level = Durability::Group;
+            else if(level == "buffered")
+              durability.level = Durability::Buffered;
+            else
+              error("Unknown durability level", level);
+          }
+          if(find(dObj, "interval", d))
+            durability.interval = d.get_int64();
+          if(find(dObj, "ops", d))
+            durability.ops = d.get_int64();
+        }
+
+        if(find(jObj, "cache", v)) {
+          const js::Object& cObj = v.get_obj();
+          js::Value c;
+          if(find(cObj, "budget", c))
+            cacheBudget = c.get_int64();
+        }
+
+        if(find(jObj, "updateLog", v)) {
+          this->updateLogFile = fs::path(v.get_str());
+        }
       } catch (exception& e) {
         error("Unable to load jashon configuration", e.what());
       }
@@ -175,7 +238,12 @@ namespace janosh {
   Janosh::Janosh() :
 		settings_(),
         triggers_(settings_.triggerFile, settings_.triggerDirs),
-        cm(makeCommandMap(this)) {
+        cm(makeCommandMap(this)),
+        threads(1),
+        binary(false),
+        offset(0),
+        limit(-1),
+        tail(false) {
   }
 
   Janosh::~Janosh() {
@@ -189,18 +257,84 @@ namespace janosh {
     return this->format;
   }
 
+  /**
+   * Sets the number of threads used to export large directories.
+   * @param n number of threads. 1 exports serially, 0 uses one thread per core.
+   */
+  void Janosh::setThreads(size_t n) {
+    this->threads = n;
+  }
+
+  /**
+   * @param b true if export and import use the binary backup format instead of json.
+   */
+  void Janosh::setBinary(bool b) {
+    this->binary = b;
+  }
+
+  /**
+   * Limits get on directories to a page of their members.
+   * @param offset number of members to skip. Counted from the end if tail is set.
+   * @param limit maximum number of members to print. -1 for no limit.
+   * @param tail true if the page is taken from the end of the directory.
+   */
+  void Janosh::setPage(size_t offset, size_t limit, bool tail) {
+    this->offset = offset;
+    this->limit = limit;
+    this->tail = tail;
+  }
+
+  bool Janosh::isPaged() const {
+    return this->offset > 0 || this->limit != size_t(-1);
+  }
+
+  /**
+   * Calculates the page of a directory with n members.
+   * @param first receives the position of the first member of the page.
+   * @param count receives the number of members on the page.
+   */
+  void Janosh::page(const size_t n, size_t& first, size_t& count) const {
+    const size_t skip = std::min(this->offset, n);
+    count = std::min(this->limit, n - skip);
+    first = this->tail ? n - skip - count : skip;
+  }
+
   void Janosh::open(bool readOnly=false) {
     // open the database
 
+    if(!Record::db) {
+      Record::db = Engine::create(settings_.engine);
+      Record::db->tune(settings_.tuning);
+      Record::db->setDurability(settings_.durability);
+      Record::cache.setBudget(settings_.cacheBudget);
+    }
+
+    // other processes may have written since the database was open last
+    Record::cache.clear();
+    Record::directories.clear();
+
     uint32_t mode;
     if(readOnly)
-      mode = kc::PolyDB::OAUTOTRAN | kc::PolyDB::OREADER;
+      mode = Engine::OAUTOTRAN | Engine::OREADER;
     else
-      mode = kc::PolyDB::OTRYLOCK | kc::PolyDB::OAUTOTRAN | kc::PolyDB::OREADER | kc::PolyDB::OWRITER | kc::PolyDB::OCREATE;
-    while (!Record::db.open(settings_.databaseFile.string(),  mode)) {
+      mode = Engine::OTRYLOCK | Engine::OAUTOTRAN | Engine::OREADER | Engine::OWRITER | Engine::OCREATE;
+    while (!Record::db->open(settings_.databaseFile.string(),  mode)) {
+      // only a database locked by another writer is waited for, other errors won't go away
+      if(!Record::db->locked())
+        throw db_exception() << string_info({"can't open database", settings_.databaseFile.string(), Record::db->error()});
+
       boost::this_thread::sleep(boost::posix_time::millisec(20));
-      LOG_ERR_MSG("open error", Record::db.error().name());
+      LOG_ERR_MSG("open error", Record::db->error());
     }
+
+    if(!readOnly && !settings_.updateLogFile.empty()) {
+      bool fresh = !fs::exists(settings_.updateLogFile);
+      Record::log.open(settings_.updateLogFile);
+      if(fresh)
+        Record::log.image(*Record::db);
+    }
+
+    Record::indexes.open(*Record::db, Record::log);
     open_ = true;
   }
 
@@ -210,8 +344,20 @@ namespace janosh {
 
   void Janosh::close() {
     if(isOpen()) {
+      const IndexSet::Stats& stats = Record::indexes.stats();
+      if(stats.writes > 0) {
+        LOG_INFO_MSG("index maintenance", boost::format("%d writes, %d index updates, %d us per write")
+            % stats.writes % stats.updates % (stats.micros / stats.writes));
+      }
+
+      if(Record::cache.enabled()) {
+        const RecordCache::Stats& cached = Record::cache.stats();
+        LOG_INFO_MSG("record cache", boost::format("%d hits, %d misses") % cached.hits % cached.misses);
+      }
+
       open_ = false;
-      Record::db.close();
+      Record::log.close();
+      Record::db->close();
     }
   }
 
@@ -254,20 +400,205 @@ namespace janosh {
 
   size_t Janosh::loadJson(std::istream& is) {
     js::Value rootValue;
-    js::read(is, rootValue);
+
+    if(this->threads != 1) {
+      const string doc((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+      size_t cnt = loadParallel(doc);
+      if(cnt > 0)
+        return cnt;
+
+      js::read(doc, rootValue);
+    } else {
+      js::read(is, rootValue);
+    }
 
     Path path;
     return load(rootValue, path);
   }
 
+  /**
+   * Finds the top level elements of a JSON array or object without parsing them.
+   * @param doc the JSON document.
+   * @param type receives '[' or '{'.
+   * @param elements receives begin and end offset of every element. Object members include their name.
+   * @return false if the document isn't an array or an object or is malformed at the top level.
+   */
+  static bool splitElements(const string& doc, char& type, vector<std::pair<size_t, size_t> >& elements) {
+    const char* ws = " \t\r\n";
+    size_t i = doc.find_first_not_of(ws);
+    if(i == string::npos || (doc[i] != '[' && doc[i] != '{'))
+      return false;
+
+    type = doc[i];
+    const char close = type == '[' ? ']' : '}';
+    size_t depth = 0;
+    size_t start = i + 1;
+    bool inString = false;
+
+    for(++i; i < doc.size(); ++i) {
+      const char c = doc[i];
+      if(inString) {
+        if(c == '\\')
+          ++i;
+        else if(c == '"')
+          inString = false;
+      } else if(c == '"') {
+        inString = true;
+      } else if(c == '[' || c == '{') {
+        ++depth;
+      } else if(c == ']' || c == '}') {
+        if(depth > 0) {
+          --depth;
+          continue;
+        }
+
+        if(c != close)
+          return false;
+
+        if(doc.find_first_not_of(ws, start) < i)
+          elements.push_back({start, i});
+        else if(!elements.empty())
+          return false;
+
+        return doc.find_first_not_of(ws, i + 1) == string::npos;
+      } else if(c == ',' && depth == 0) {
+        if(doc.find_first_not_of(ws, start) >= i)
+          return false;
+
+        elements.push_back({start, i});
+        start = i + 1;
+      }
+    }
+
+    return false;
+  }
+
+  /**
+   * Loads a JSON array or object on several threads.
+   * The document is split at its top level elements. The elements are parsed and encoded into sorted runs concurrently,
+   * the runs are merged into the database in key order within one transaction.
+   * Array elements get the index of their position in the document.
+   * @param doc the JSON document.
+   * @return number of loaded records. 0 if the document isn't split, it has to be loaded serially then.
+   */
+  size_t Janosh::loadParallel(const string& doc) {
+    char type;
+    vector<std::pair<size_t, size_t> > elements;
+    if(!splitElements(doc, type, elements))
+      return 0;
+
+    TaskPool pool(this->threads);
+    const size_t tasks = std::min(elements.size(), pool.size() * 8);
+    if(pool.size() < 2 || tasks < 2)
+      return 0;
+
+    vector<Run> runs(tasks);
+    vector<size_t> counts(tasks, 0);
+    vector<vector<string> > names(tasks);
+
+    pool.run(tasks, [&](size_t t) {
+      const size_t first = t * elements.size() / tasks;
+      const size_t last = (t + 1) * elements.size() / tasks;
+      Path path;
+
+      for(size_t i = first; i < last; ++i) {
+        string element = doc.substr(elements[i].first, elements[i].second - elements[i].first);
+        if(type == '{')
+          element = '{' + element + '}';
+
+        js::Value v;
+        if(!js::read(element, v))
+          throw janosh_exception() << string_info({"malformed JSON element", element.substr(0, 80)});
+
+        if(type == '[') {
+          path.pushIndex(i);
+          counts[t] += load(v, path, &runs[t]);
+        } else {
+          js::Pair& p = v.get_obj().front();
+          names[t].push_back(p.name_);
+          path.pushMember(p.name_);
+          counts[t] += load(p.value_, path, &runs[t]);
+        }
+        path.pop();
+        ++counts[t];
+      }
+
+      std::stable_sort(runs[t].begin(), runs[t].end(), [](const Run::value_type& a, const Run::value_type& b) {
+        return a.first < b.first;
+      });
+    });
+
+    // members of the same name end up as one, like in a serial load
+    size_t size = elements.size();
+    if(type == '{') {
+      std::set<string> distinct;
+      for(const vector<string>& n : names)
+        distinct.insert(n.begin(), n.end());
+      size = distinct.size();
+    }
+
+    Transaction txn(*Record::db);
+    Path root;
+    root.pushMember(".");
+    size_t cnt = load(root, Value::encodeContainer(type == '[' ? Value::Array : Value::Object, size));
+
+    // merge in key order. Equal keys are written in document order so the last one wins, like in a serial load.
+    typedef std::pair<const Run::value_type*, size_t> Head;
+    auto later = [](const Head& a, const Head& b) {
+      const int c = a.first->first.compare(b.first->first);
+      return c > 0 || (c == 0 && a.second > b.second);
+    };
+    std::priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+    vector<size_t> positions(tasks, 0);
+
+    for(size_t t = 0; t < tasks; ++t) {
+      if(!runs[t].empty())
+        heads.push({&runs[t].front(), t});
+    }
+
+    while(!heads.empty()) {
+      const Head head = heads.top();
+      heads.pop();
+
+      const string& key = head.first->first;
+      const string& value = head.first->second;
+      if(!Record::db->set(key, value))
+        throw db_exception() << string_info({"failed to load record", key});
+      Record::written(key, value);
+
+      const size_t t = head.second;
+      if(++positions[t] < runs[t].size())
+        heads.push({&runs[t][positions[t]], t});
+    }
+
+    txn.commit();
+
+    for(size_t t = 0; t < tasks; ++t)
+      cnt += counts[t];
+
+    return cnt;
+  }
+
 
   /**
    * Recursively traverses a record and prints it out.
    * @param rec The record to print out.
    * @param out The output stream to write to.
+   * @param filter Optional filter, only the members of the directory that match it are printed.
    * @return number of total records affected.
    */
-  size_t Janosh::get(Record rec, std::ostream& out) {
+  size_t Janosh::get(Record rec, std::ostream& out, const Filter* filter) {
+    size_t from = 0, to = std::numeric_limits<size_t>::max();
+    const bool slice = rec.path().isSlice();
+    if(slice) {
+      const Component c = rec.path().name();
+      from = c.sliceBegin();
+      to = c.sliceEnd();
+    }
+
+    if((filter || isPaged() || slice) && (rec.path().isWildcard() || slice))
+      rec = Record(rec.path().asDirectory());
+
     rec.fetch();
     size_t cnt = 1;
 
@@ -277,7 +608,52 @@ namespace janosh {
       throw janosh_exception() << record_info({"Path not found", rec});
     }
 
-    if (rec.isDirectory()) {
+    if (filter || slice || (isPaged() && rec.isDirectory())) {
+      if(!rec.isDirectory())
+        throw janosh_exception() << record_info({"Filters apply to directories only", rec});
+
+      if(slice && !rec.isArray())
+        throw janosh_exception() << record_info({"Slices apply to arrays only", rec});
+
+      vector<std::pair<string, string> > ranges;
+      const size_t size = selectMembers(rec, filter, from, to, ranges);
+
+      switch(this->getFormat()) {
+        case Json:
+          cnt = recurseMembers(rec, ranges, size, JsonPrintVisitor(out));
+          break;
+        case Bash:
+          cnt = recurseMembers(rec, ranges, size, BashPrintVisitor(out));
+          break;
+        case Raw:
+          cnt = recurseMembers(rec, ranges, size, RawPrintVisitor(out));
+          break;
+        case Msgpack:
+          cnt = recurseMembers(rec, ranges, size, MsgpackPrintVisitor(out));
+          break;
+        case Lines:
+          cnt = recurseMembers(rec, ranges, size, LinesPrintVisitor(out));
+          break;
+      }
+    } else if (rec.isDirectory() && this->threads != 1) {
+      switch(this->getFormat()) {
+        case Json:
+          cnt = recurseParallel<JsonPrintVisitor>(rec, out);
+          break;
+        case Bash:
+          cnt = recurseParallel<BashPrintVisitor>(rec, out);
+          break;
+        case Raw:
+          cnt = recurseParallel<RawPrintVisitor>(rec, out);
+          break;
+        case Msgpack:
+          cnt = recurseParallel<MsgpackPrintVisitor>(rec, out);
+          break;
+        case Lines:
+          cnt = recurseLeaves<LinesPrintVisitor>(rec, out);
+          break;
+      }
+    } else if (rec.isDirectory()) {
       switch(this->getFormat()) {
         case Json:
           cnt = recurse(rec, JsonPrintVisitor(out));
@@ -288,6 +664,12 @@ namespace janosh {
         case Raw:
           cnt = recurse(rec, RawPrintVisitor(out));
           break;
+        case Msgpack:
+          cnt = recurse(rec, MsgpackPrintVisitor(out));
+          break;
+        case Lines:
+          cnt = recurseLeaves<LinesPrintVisitor>(rec, out);
+          break;
       }
     } else {
       string value;
@@ -300,11 +682,196 @@ namespace janosh {
         case Bash:
           out << "\"( [" << rec.path() << "]='" << rec.value() << "' )\"" << endl;
           break;
+        case Msgpack: {
+          MsgpackPrintVisitor vis(out);
+          vis.begin();
+          vis.record(rec.path(), rec.value(), false, true);
+          break;
+        }
+        case Lines:
+          LinesPrintVisitor(out).record(rec.path(), rec.value(), false, true);
+          break;
       }
     }
     return cnt;
   }
 
+  /**
+   * Prints out several records.
+   * The paths are visited in key order with a single cursor, the output is written in the order of the paths.
+   * @param paths The paths of the records to print out.
+   * @param out The output stream to write to.
+   * @param filter Optional filter applied to every path.
+   * @return number of total records affected.
+   */
+  size_t Janosh::get(const vector<string>& paths, std::ostream& out, const Filter* filter) {
+    if(paths.empty())
+      return 0;
+
+    vector<std::pair<Path, size_t> > sorted;
+    sorted.reserve(paths.size());
+    for(size_t i = 0; i < paths.size(); ++i)
+      sorted.push_back({Path(paths[i]), i});
+
+    std::sort(sorted.begin(), sorted.end());
+
+    std::ostringstream buffer;
+    vector<std::pair<size_t, size_t> > segments(paths.size());
+    Record rec(sorted.front().first);
+    size_t cnt = 0;
+
+    for(size_t i = 0; i < sorted.size(); ++i) {
+      const size_t index = sorted[i].second;
+      if(i > 0 && sorted[i].first == sorted[i - 1].first) {
+        segments[index] = segments[sorted[i - 1].second];
+        continue;
+      }
+
+      const size_t begin = buffer.tellp();
+      cnt += get(rec.fetch(sorted[i].first), buffer, filter);
+      segments[index] = {begin, buffer.tellp()};
+    }
+
+    const string& printed = buffer.str();
+    for(const std::pair<size_t, size_t>& s : segments)
+      out.write(printed.data() + s.first, s.second - s.first);
+
+    return cnt;
+  }
+
+  /**
+   * Computes an aggregate over a field of the members of a directory and prints it, see Aggregate.
+   * With more than one thread the members are split into parts that are scanned concurrently.
+   * @param op the operation.
+   * @param pattern the aggregated field, like /stats/ * /bytes (without the blanks).
+   * @param out The output stream to write to.
+   * @return number of aggregated fields.
+   */
+  size_t Janosh::aggregate(const string& op, const string& pattern, std::ostream& out) {
+    Aggregate agg(op, pattern);
+    Record dir(Path(agg.prefix() + '!'));
+    if(!dir.fetch().exists())
+      throw janosh_exception() << record_info({"Path not found", dir});
+
+    TaskPool pool(this->threads);
+    const vector<std::pair<string, string> > ranges = memberRanges(agg.prefix(), pool.size());
+
+    if(ranges.size() < 2) {
+      agg.scan("", "");
+    } else {
+      vector<Aggregate> parts(ranges.size(), agg);
+      pool.run(ranges.size(), [&](size_t t) {
+        parts[t].scan(ranges[t].first, ranges[t].second);
+      });
+
+      for(const Aggregate& part : parts)
+        agg.merge(part);
+    }
+
+    agg.print(out);
+    return agg.size();
+  }
+
+  /**
+   * Collects the key of the first record of every member of a directory that follows the directory header.
+   * The subtree of a member directory is skipped with a single jump.
+   * @param prefix the key prefix of the directory.
+   * @return the keys in key order.
+   */
+  vector<string> Janosh::memberKeys(const string& prefix) {
+    boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+    const string header = prefix + '!';
+    vector<string> keys;
+    string key;
+
+    if(!cur->jump(header))
+      return keys;
+
+    while(cur->get_key(&key) && key.compare(0, prefix.size(), prefix) == 0) {
+      if(key == header) {
+        cur->step();
+        continue;
+      }
+
+      keys.push_back(key);
+      if(!Record::skipMember(*cur, key, prefix.size()))
+        break;
+    }
+
+    return keys;
+  }
+
+  /**
+   * Splits the members of a directory into key ranges holding about the same number of members,
+   * several per worker so a worker that finishes early picks up another range.
+   * @param prefix the key prefix of the directory.
+   * @param workers the number of threads the ranges are processed with.
+   * @return the ranges in key order as start and end key, an empty end key stands for the end of the directory.
+   * Fewer than two ranges for a single worker or a directory with less than two members.
+   */
+  vector<std::pair<string, string> > Janosh::memberRanges(const string& prefix, size_t workers) {
+    vector<std::pair<string, string> > ranges;
+    if(workers < 2)
+      return ranges;
+
+    const vector<string> members = memberKeys(prefix);
+    const size_t n = std::min(members.size(), workers * 8);
+    for(size_t t = 0; t < n; ++t) {
+      ranges.push_back({members[t * members.size() / n],
+          t + 1 < n ? members[(t + 1) * members.size() / n] : ""});
+    }
+    return ranges;
+  }
+
+  /**
+   * Selects the members of a directory that match a filter and fall on the current page.
+   * A page of an unfiltered array is located by seeking to the keys of its first and its last index,
+   * so the cost depends on the size of the page only. Otherwise the member keys are collected first.
+   * @param dir the directory.
+   * @param filter optional filter the members have to match.
+   * @param from index of the first member to consider, members of a slice.
+   * @param to index the considered members end before.
+   * @param ranges receives the key ranges of the selected members, as begin and end key in key order.
+   * An empty end key stands for the end of the directory.
+   * @return number of selected members.
+   */
+  size_t Janosh::selectMembers(Record& dir, const Filter* filter, size_t from, size_t to, vector<std::pair<string, string> >& ranges) {
+    size_t first, count;
+
+    if(!filter && dir.isArray()) {
+      from = std::min(from, dir.getSize());
+      to = std::max(from, std::min(to, dir.getSize()));
+      page(to - from, first, count);
+      first += from;
+      if(count > 0) {
+        Path begin = dir.path().basePath();
+        Path end = begin;
+        begin.pushIndex(first);
+        end.pushIndex(first + count);
+
+        // the first key of the member, its value or its directory header
+        boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+        string key;
+        if(!cur->jump(begin.key()) || !cur->get_key(&key))
+          throw janosh_exception() << record_info({"Array member missing", dir});
+        ranges.push_back({key, end.key()});
+      }
+      return count;
+    }
+
+    const string prefix = dir.path().basePath().key() + '/';
+    const vector<string> members = memberKeys(prefix);
+    vector<std::pair<string, string> > selected;
+    for(size_t i = from; i < std::min(to, members.size()); ++i) {
+      if(!filter || filter->matches(members[i].substr(0, members[i].find('/', prefix.size()))))
+        selected.push_back({members[i], i + 1 < members.size() ? members[i + 1] : ""});
+    }
+
+    page(selected.size(), first, count);
+    ranges.assign(selected.begin() + first, selected.begin() + first + count);
+    return count;
+  }
+
   /**
    * Creates a temporary record with the given type.
    * @param t the type of the record to create.
@@ -348,7 +915,12 @@ namespace janosh {
       throw janosh_exception() << record_info({"Out of array bounds",target});
     }
     changeContainerSize(target.parent(), 1);
-    return Record::db.add(target.path(), "A" + lexical_cast<string>(size)) ? 1 : 0;
+    const string value = Value::encodeContainer(Value::Array, size);
+    if(!Record::db->add(target.path(), value))
+      return 0;
+
+    Record::written(target.path(), value);
+    return 1;
   }
 
   /**
@@ -372,7 +944,12 @@ namespace janosh {
 
     if(!target.path().isRoot())
       changeContainerSize(target.parent(), 1);
-    return Record::db.add(target.path(), "O" + lexical_cast<string>(size)) ? 1 : 0;
+    const string value = Value::encodeContainer(Value::Object, size);
+    if(!Record::db->add(target.path(), value))
+      return 0;
+
+    Record::written(target.path(), value);
+    return 1;
   }
 
 
@@ -396,12 +973,22 @@ namespace janosh {
   }
 
   /**
-   * Adds a record with the given value to the database.
+   * Adds a record with the given string value to the database.
    * Does not modify an existing record.
    * @param dest destination record
    * @return 1 if successful, 0 if not
    */
   size_t Janosh::add(Record dest, const string& value) {
+    return add(dest, Value(Value::encodeString(value), false));
+  }
+
+  /**
+   * Adds a record with the given typed value to the database.
+   * Does not modify an existing record.
+   * @param dest destination record
+   * @return 1 if successful, 0 if not
+   */
+  size_t Janosh::add(Record dest, const Value& value) {
     JANOSH_TRACE({dest}, value);
 
     if(!dest.isValue() || dest.exists()) {
@@ -412,22 +999,34 @@ namespace janosh {
       throw janosh_exception() << record_info({"Out of array bounds",dest});
     }
 
-    if(Record::db.add(dest.path(), value)) {
+    Transaction txn(*Record::db);
+    if(Record::db->add(dest.path(), value.encoded())) {
+      Record::written(dest.path(), value.encoded());
 //      if(!dest.path().isRoot())
         changeContainerSize(dest.parent(), 1);
+      txn.commit();
       return 1;
     } else {
+      txn.commit();
       return 0;
     }
   }
 
   /**
-   * Relaces a the value of a record.
-   * If the destination record exists create it.
+   * Relaces a the value of a record with a string.
    * @param dest destination record
    * @return 1 if successful, 0 if not
    */
   size_t Janosh::replace(Record dest, const string& value) {
+    return replace(dest, Value(Value::encodeString(value), false));
+  }
+
+  /**
+   * Relaces a the value of a record with a typed value.
+   * @param dest destination record
+   * @return 1 if successful, 0 if not
+   */
+  size_t Janosh::replace(Record dest, const Value& value) {
     JANOSH_TRACE({dest}, value);
     dest.fetch();
 
@@ -439,7 +1038,15 @@ namespace janosh {
       throw janosh_exception() << record_info({"Out of array bounds", dest});
     }
 
-    return Record::db.replace(dest.path(), value);
+    Transaction txn(*Record::db);
+    if(!Record::db->replace(dest.path(), value.encoded())) {
+      txn.commit();
+      return 0;
+    }
+
+    Record::written(dest.path(), value.encoded());
+    txn.commit();
+    return 1;
   }
 
 
@@ -463,6 +1070,7 @@ namespace janosh {
       throw janosh_exception() << record_info({"Out of array bounds", dest});
     }
 
+    Transaction txn(*Record::db);
     Record target;
     size_t r;
     if(dest.isDirectory()) {
@@ -487,9 +1095,12 @@ namespace janosh {
         dest = target;
 
       } else {
-        r = Record::db.replace(dest.path(), src.value());
+        r = Record::db->replace(dest.path(), src.value().encoded());
+        if(r)
+          Record::written(dest.path(), src.value().encoded());
       }
     }
+    txn.commit();
 
     src.fetch();
     dest.fetch();
@@ -498,22 +1109,34 @@ namespace janosh {
   }
 
   /**
-   * Copies source record value to the destination record - eventually removing the source record.
-   * If the destination record exists replaces it.
+   * Moves a record or a directory with everything below it to the destination path.
+   * The keys are rewritten under the destination prefix in one pass and in one transaction.
+   * If the destination record exists it is replaced. If the source was an array member, the array is packed.
    * @param src source record. Points to the destination record after moving.
    * @param dest destination record.
-   * @return number of copied records
+   * @return number of moved records
    */
   size_t Janosh::move(Record& src, Record& dest) {
     JANOSH_TRACE({src, dest});
     src.fetch();
     dest.fetch();
 
+    if(src.isSlice()) {
+      // append the members to the destination directory, then drop them from the source array
+      Transaction txn(*Record::db);
+      size_t cnt = copy(src, dest);
+      remove(src);
+      txn.commit();
+      dest = Record(dest.path());
+      src = dest;
+      return cnt;
+    }
+
     if(src.isRange() || !src.exists()) {
       throw janosh_exception() << record_info({"Invalid src", src});
     }
 
-    if(dest.path().isRoot()) {
+    if(dest.path().isRoot() || dest.isRange()) {
       throw janosh_exception() << record_info({"Invalid target", dest});
     }
 
@@ -521,45 +1144,159 @@ namespace janosh {
       throw janosh_exception() << record_info({"Out of array bounds", dest});
     }
 
-    Record target;
-    size_t r;
-    if(dest.isDirectory()) {
-      if(src.isDirectory())
-        target = dest;
-      else
-        target = dest.path().basePath();
+    const bool dir = src.isDirectory();
+    const Path target = dir ? dest.path().asDirectory() : dest.path().basePath();
+    if(target == src.path())
+      return 0;
 
-      if(dest.exists())
-        remove(dest);
+    const string from = src.path().basePath().key() + (dir ? "/" : "");
+    const string to = target.basePath().key() + (dir ? "/" : "");
+    const string targetPrefix = target.basePath().key() + '/';
 
-      r = this->copy(src,target);
-      dest = target;
-    } else {
-      if(src.isDirectory()) {
-        target = dest.parent();
+    if(dir && to.compare(0, from.size(), from) == 0) {
+      throw janosh_exception() << record_info({"can't move a directory below itself", dest});
+    }
 
-        if(dest.exists())
-          remove(dest);
+    if(from.compare(0, targetPrefix.size(), targetPrefix) == 0) {
+      throw janosh_exception() << record_info({"can't replace an ancestor", dest});
+    }
 
-        r = this->copy(src, target);
-        dest = target;
-      } else {
-        r = Record::db.replace(dest.path(), src.value());
-      }
+    Transaction txn(*Record::db);
+    const Path srcParent = src.path().parent();
+    const Path destParent = target.parent();
+
+    Record destDir(destParent);
+    destDir.fetch();
+    if(!destDir.exists()) {
+      throw janosh_exception() << record_info({"Invalid target", dest});
     }
-    remove(src);
+
+    // free the destination slot without packing, it is filled again right away
+    Record existingValue(target.basePath());
+    if(existingValue.fetch().exists())
+      remove(existingValue, false);
+
+    Record existingDir(target.basePath().asDirectory());
+    if(existingDir.fetch().exists())
+      remove(existingDir, false);
+
+    changeContainerSize(Record(destParent), 1);
+    size_t cnt = rename(from, to, dir);
+    changeContainerSize(Record(srcParent), -1);
+
+    Record srcDir(srcParent);
+    if(srcDir.fetch().isArray())
+      pack(srcDir);
+
+    txn.commit();
+    dest = Record(target);
     src = dest;
 
-    return r;
+    return cnt;
+  }
+
+  /**
+   * Rewrites the key of a record, or the key prefix of a whole subtree, in one ordered pass.
+   * Doesn't update any directory size.
+   * @param from the source key, or key prefix if subtree is true.
+   * @param to the destination key, or key prefix if subtree is true.
+   * @param subtree rewrite all keys starting with from.
+   * @return number of moved records
+   */
+  size_t Janosh::rename(const string& from, const string& to, bool subtree) {
+    boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+    string key, value;
+    size_t cnt = 0;
+
+    cur->jump(from);
+    while(cur->get(&key, &value)) {
+      if(subtree ? key.compare(0, from.size(), from) != 0 : key != from)
+        break;
+
+      const string destKey = to + key.substr(from.size());
+      if(!Record::db->add(destKey, value)) {
+        throw janosh_exception() << record_info({"add failed", Record(destKey)});
+      }
+      Record::written(destKey, value);
+
+      if(!cur->remove()) {
+        throw db_exception() << record_info({"failed to remove record", Record(key)});
+      }
+      Record::erased(key);
+      ++cnt;
+    }
+
+    return cnt;
   }
 
+  /**
+   * Renumbers the members of an array so that the indexes are dense again.
+   * Members are renamed together with everything below them in one ordered pass.
+   * @param array the array to pack.
+   * @return the size of the packed array.
+   */
+  size_t Janosh::pack(Record& array) {
+    boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+    const string prefix = array.path().basePath().key() + '/';
+    const string header = prefix + '!';
+    string key, value, from, to;
+    size_t cnt = 0;
+
+    cur->jump(prefix);
+    while(cur->get(&key, &value)) {
+      if(key.compare(0, prefix.size(), prefix) != 0)
+        break;
+
+      const size_t end = key.find('/', prefix.size());
+      const size_t len = (end == string::npos ? key.size() : end) - prefix.size();
+
+      if(key == header) {
+        cur->step();
+        continue;
+      }
+
+      if(cnt == 0 || key.compare(0, prefix.size() + len, from) != 0) {
+        from = key.substr(0, prefix.size() + len);
+        to = array.path().withChild(cnt).key();
+        ++cnt;
+      }
+
+      if(from == to) {
+        cur->step();
+        continue;
+      }
+
+      const string destKey = to + key.substr(from.size());
+      if(!Record::db->add(destKey, value)) {
+        throw janosh_exception() << record_info({"add failed", Record(destKey)});
+      }
+      Record::written(destKey, value);
+
+      if(!cur->remove()) {
+        throw db_exception() << record_info({"failed to remove record", array});
+      }
+      Record::erased(key);
+    }
+
+    setContainerSize(array, cnt);
+    return cnt;
+  }
 
   /**
-   * Sets/replaces the value of a record. If no record exists, creates the record with corresponding value.
+   * Sets/replaces the value of a record with a string. If no record exists, creates the record with corresponding value.
    * @param rec The record to manipulate
    * @return 1 if successful, 0 if not
    */
   size_t Janosh::set(Record rec, const string& value) {
+    return set(rec, Value(Value::encodeString(value), false));
+  }
+
+  /**
+   * Sets/replaces the value of a record with a typed value. If no record exists, creates the record with corresponding value.
+   * @param rec The record to manipulate
+   * @return 1 if successful, 0 if not
+   */
+  size_t Janosh::set(Record rec, const Value& value) {
     JANOSH_TRACE({rec}, value);
 
     if(!rec.isValue()) {
@@ -578,6 +1315,84 @@ namespace janosh {
   }
 
 
+  /**
+   * Adds the records of a list of path/value pairs in one transaction, see writePairs.
+   * @return number of added records.
+   */
+  size_t Janosh::add(vector<string>::const_iterator begin, vector<string>::const_iterator end) {
+    return writePairs(begin, end, true, false);
+  }
+
+  /**
+   * Replaces the values of a list of path/value pairs in one transaction, see writePairs.
+   * @return number of replaced records.
+   */
+  size_t Janosh::replace(vector<string>::const_iterator begin, vector<string>::const_iterator end) {
+    return writePairs(begin, end, false, true);
+  }
+
+  /**
+   * Sets the values of a list of path/value pairs in one transaction, see writePairs.
+   * @return number of written records.
+   */
+  size_t Janosh::set(vector<string>::const_iterator begin, vector<string>::const_iterator end) {
+    return writePairs(begin, end, true, true);
+  }
+
+  /**
+   * Writes the string values of a list of path/value pairs in one transaction, all or nothing.
+   * The bounds of array members are checked against the array size including the members added by earlier pairs,
+   * the size of every parent directory is updated once after all pairs were written.
+   * @param begin the first path, followed by its value.
+   * @param end the end of the pairs.
+   * @param create allow adding records that don't exist.
+   * @param overwrite allow replacing records that exist.
+   * @return number of written records.
+   */
+  size_t Janosh::writePairs(vector<string>::const_iterator begin, vector<string>::const_iterator end, bool create, bool overwrite) {
+    Transaction txn(*Record::db);
+    std::map<Path, size_t> added;
+    size_t cnt = 0;
+
+    for(auto it = begin; it != end; it += 2) {
+      Record dest(*it);
+      const Value value(Value::encodeString(*(it + 1)), false);
+      JANOSH_TRACE({dest}, value);
+      dest.fetch();
+
+      if(!dest.isValue() || (dest.exists() ? !overwrite : !create)) {
+        throw janosh_exception() << record_info({"Invalid target", dest});
+      }
+
+      const Path parent = dest.path().parent();
+      DirectoryCache::Entry dir;
+      size_t& grown = added[parent];
+      if(!parent.isRoot() && directory(parent, dir) && dir.type == Value::Array && dest.path().parseIndex() > dir.size + grown) {
+        throw janosh_exception() << record_info({"Out of array bounds", dest});
+      }
+
+      if(dest.exists()) {
+        if(!Record::db->replace(dest.path(), value.encoded()))
+          throw db_exception() << record_info({"failed to replace record", dest});
+      } else {
+        if(!Record::db->add(dest.path(), value.encoded()))
+          throw db_exception() << record_info({"failed to add record", dest});
+        ++grown;
+      }
+
+      Record::written(dest.path(), value.encoded());
+      ++cnt;
+    }
+
+    for(const std::pair<const Path, size_t>& a : added) {
+      if(a.second > 0)
+        changeContainerSize(Record(a.first), a.second);
+    }
+
+    txn.commit();
+    return cnt;
+  }
+
   /**
    * Recursivley removes a record from the database.
    * @param rec The record to remove. Points to the next record in the database after removal.
@@ -587,59 +1402,98 @@ namespace janosh {
     JANOSH_TRACE({rec});
     if(!rec.isInitialized())
       return 0;
+
+    if(rec.path().isSlice())
+      return removeSlice(rec);
  
+    Transaction txn(*Record::db);
     size_t n = rec.fetch().getSize();
     size_t cnt = 0;
 
     Record parent = rec.parent();
     Path targetPath = rec.path();
-    Record target(targetPath);
     parent.fetch();
-    target.fetch();
 
-    if(target.isDirectory())
-      rec.step();
-
-    for(size_t i = 0; i < n; ++i) {
-       if(!rec.isDirectory()) {
-         rec.remove();
-         ++cnt;
-       } else {
-         remove(rec,false);
-       }
-     }
-
-    if(target.isDirectory()) {
-      target.remove();
+    if(rec.isDirectory()) {
+      cnt = removeSubtree(rec);
       changeContainerSize(parent, -1);
     } else {
+      for(size_t i = 0; i < n; ++i) {
+         if(!rec.isDirectory()) {
+           rec.remove();
+           ++cnt;
+         } else {
+           remove(rec,false);
+         }
+       }
+
       changeContainerSize(parent, cnt * -1);
     }
 
     if(pack && parent.isArray()) {
-      parent.read();
-      Record child = Record(parent.path()).fetch();
-      size_t left = parent.getSize();
-      child.step();
-      for(size_t i = 0; i < left; ++i) {
-        child.fetch();
-
-        if(child.parent().path() != parent.path()) {
-          throw db_exception() << record_info({"corrupted array detected", parent});
-        }
-        if(child.getIndex() > i) {
-          Record indexPos(parent.path().withChild(i));
-          copy(child, indexPos);
-          child.remove();
-        } else {
-          child.next();
-        }
-      }
-      setContainerSize(parent, left);
+      Record array(parent.path());
+      this->pack(array.fetch());
     }
 
-    rec = target;
+    txn.commit();
+    return cnt;
+  }
+
+  /**
+   * Removes the members selected by an array slice in one ordered sweep over their key range,
+   * then packs the array once.
+   * @param slice the slice record. Points to the record following the range afterwards.
+   * @return number of removed members.
+   */
+  size_t Janosh::removeSlice(Record& slice) {
+    Transaction txn(*Record::db);
+    string begin, end, key;
+    const size_t n = slice.range(begin, end);
+    Engine::Cursor* cur = slice.getCursorPtr();
+
+    cur->jump(begin);
+    while(n > 0 && cur->get_key(&key) && key < end) {
+      if(!cur->remove())
+        throw db_exception() << record_info({"failed to remove record", slice});
+
+      Record::erased(key);
+    }
+
+    Record array(slice.path().asDirectory());
+    changeContainerSize(array, n * -1);
+    pack(array.fetch());
+
+    txn.commit();
+    slice.clear();
+    slice.readPath();
+    return n;
+  }
+
+  /**
+   * Removes a directory and everything below it in one ordered sweep over the key prefix of the directory.
+   * Doesn't update the size of the parent directory.
+   * @param dir the directory record to remove. Points to the record following the subtree afterwards.
+   * @return number of removed records that were direct non-directory children of dir.
+   */
+  size_t Janosh::removeSubtree(Record& dir) {
+    const string header = dir.path().key();
+    const string prefix = header.substr(0, header.size() - 1);
+    Engine::Cursor* cur = dir.getCursorPtr();
+    string key;
+    size_t cnt = 0;
+
+    cur->jump(prefix);
+    while(cur->get_key(&key) && key.compare(0, prefix.size(), prefix) == 0) {
+      if(!cur->remove())
+        throw db_exception() << record_info({"failed to remove record", dir});
 
+      Record::erased(key);
+      if(key != header && key.find('/', prefix.size()) == string::npos)
+        ++cnt;
+    }
+
+    dir.clear();
+    dir.readPath();
     return cnt;
   }
 
@@ -648,13 +1502,15 @@ namespace janosh {
    * @return number of total records printed.
    */
   size_t Janosh::dump() {
-    kc::DB::Cursor* cur = Record::db.cursor();
+    Engine::Cursor* cur = Record::db->cursor();
     string key,value;
-    cur->jump();
+    // index records sort before the document tree
+    cur->jump("/");
     size_t cnt = 0;
 
     while(cur->get(&key, &value, true)) {
-      std::cout << "path:" << Path(key).pretty() <<  " value:" << value << endl;
+      const Path p(key);
+      std::cout << "path:" << p.pretty() <<  " value:" << Value(value, p.isDirectory()) << endl;
       ++cnt;
     }
     delete cur;
@@ -666,7 +1522,7 @@ namespace janosh {
    * @return number of total records hashed.
    */
   size_t Janosh::hash() {
-    kc::DB::Cursor* cur = Record::db.cursor();
+    Engine::Cursor* cur = Record::db->cursor();
     string key,value;
     cur->jump();
     size_t cnt = 0;
@@ -686,12 +1542,192 @@ namespace janosh {
    * @return 1 on success, 0 on fail
    */
   size_t Janosh::truncate() {
-    if(Record::db.clear())
-      return Record::db.add("/!", "O" + lexical_cast<string>(0)) ? 1 : 0;
-    else
+    if(Record::db->clear()) {
+      Record::cleared();
+      const string value = Value::encodeContainer(Value::Object, 0);
+      if(!Record::db->add("/!", value))
+        return 0;
+
+      Record::written("/!", value);
+      return 1;
+    } else
       return false;
   }
 
+  /**
+   * Rewrites all records stored in a format of an older version:
+   * text directory headers become fixed width binary headers and untagged leaves become tagged strings.
+   * Runs in a single transaction.
+   * @return number of records rewritten.
+   */
+  size_t Janosh::migrate() {
+    Engine::Cursor* cur = Record::db->cursor();
+    string key, value;
+    size_t cnt = 0;
+
+    Transaction txn(*Record::db);
+    cur->jump("/");
+    while(cur->get(&key, &value)) {
+      const Path p(key);
+      const Value v(value, p.isDirectory());
+
+      if(v.isLegacy()) {
+        const string migrated = v.getType() == Value::String
+            ? Value::encodeString(v.str())
+            : Value::encodeContainer(v.getType(), v.getSize());
+
+        if(!cur->set_value_str(migrated)) {
+          delete cur;
+          throw db_exception() << string_info({"migration failed", Record::db->error()});
+        }
+        Record::written(key, migrated);
+        ++cnt;
+      }
+      cur->step();
+    }
+    delete cur;
+    txn.commit();
+    return cnt;
+  }
+
+  /**
+   * Applies the update log of this database to a follower database file.
+   * Prints the replication lag after each pass that applied entries.
+   * @param followerFile the follower database file.
+   * @param interval poll interval in milliseconds. 0 means catch up once and return.
+   * @param out The output stream to write the lag metric to.
+   * @return number of applied log entries.
+   */
+  size_t Janosh::follow(const fs::path& followerFile, size_t interval, std::ostream& out) {
+    if(settings_.updateLogFile.empty()) {
+      throw replication_exception() << msg_info("no update log configured");
+    }
+
+    Follower follower(settings_.updateLogFile, followerFile);
+    size_t cnt = 0;
+
+    do {
+      size_t applied = follower.poll();
+      cnt += applied;
+
+      if(applied > 0 || interval == 0) {
+        Follower::Lag lag = follower.lag();
+        out << "applied=" << applied
+            << " position=" << lag.position
+            << " end=" << lag.end
+            << " lag_bytes=" << lag.bytes
+            << " lag_ms=" << lag.millis << endl;
+      }
+
+      if(interval > 0)
+        boost::this_thread::sleep(boost::posix_time::millisec(interval));
+    } while(interval > 0);
+
+    return cnt;
+  }
+
+  /**
+   * Writes the database as an immutable memory mapped snapshot file.
+   * @param snapshotFile the file to write.
+   * @return number of records written.
+   */
+  size_t Janosh::snapshot(const fs::path& snapshotFile) {
+    return SnapshotEngine::write(*Record::db, snapshotFile.string());
+  }
+
+  /**
+   * Writes the whole database to a file, either as json or as a binary backup.
+   * @param file the file to write.
+   * @return number of records written.
+   */
+  size_t Janosh::exportFile(const fs::path& file) {
+    if(this->binary)
+      return Backup::write(*Record::db, file.string());
+
+    std::ofstream os(file.string().c_str(), std::ios::out | std::ios::trunc);
+    Record root("/.");
+    size_t cnt;
+    if(this->threads != 1)
+      cnt = recurseParallel<JsonPrintVisitor>(root, os);
+    else
+      cnt = recurse(root, JsonPrintVisitor(os));
+    os.close();
+
+    if(!os.good())
+      throw janosh_exception() << string_info({"failed to write export", file.string()});
+    return cnt;
+  }
+
+  /**
+   * Reads a file written by export.
+   * A binary backup replaces the whole database in one transaction, json is loaded into it.
+   * @param file the file to read.
+   * @return number of records read.
+   */
+  size_t Janosh::importFile(const fs::path& file) {
+    if(!this->binary)
+      return loadJson(file.string());
+
+    Transaction txn(*Record::db);
+    if(!Record::db->clear())
+      throw db_exception() << string_info({"failed to clear database", Record::db->error()});
+    Record::cleared();
+
+    size_t cnt = Backup::read(file.string(), *Record::db, Record::log);
+    txn.commit();
+
+    // the backup carries the indexes along with the records
+    Record::indexes.open(*Record::db, Record::log);
+    return cnt;
+  }
+
+  /**
+   * Compacts the database file in small bursts. The database is reopened for every burst
+   * so readers only wait for one burst at a time.
+   * Stops when no fragments are left or a burst doesn't reduce them any further.
+   * @param step number of defragmentation steps per burst.
+   * @param pause pause between bursts in milliseconds.
+   * @return number of bursts.
+   */
+  size_t Janosh::defrag(int64_t step, size_t pause) {
+    size_t bursts = 0;
+    int64_t last = -1;
+
+    while(true) {
+      open(false);
+      int64_t frag = Record::db->fragments();
+      LOG_INFO_MSG("fragments", frag);
+
+      if(frag == 0 || (last >= 0 && frag >= last)) {
+        close();
+        break;
+      }
+
+      if(!Record::db->defrag(step)) {
+        string err = Record::db->error();
+        close();
+        throw db_exception() << string_info({"defrag failed", err});
+      }
+      close();
+
+      last = frag;
+      ++bursts;
+      boost::this_thread::sleep(boost::posix_time::millisec(pause));
+    }
+
+    return bursts;
+  }
+
+  /**
+   * Writes all buffered changes of the database to the disk.
+   * @return 1 if successful.
+   */
+  size_t Janosh::sync() {
+    if(!Record::db->sync())
+      throw db_exception() << string_info({"sync failed", Record::db->error()});
+    return 1;
+  }
+
   /**
    * Returns the size of a directory record
    * @param rec the directory record
@@ -724,9 +1760,12 @@ namespace janosh {
     size_t cnt = 0;
 
     for(; begin != end; ++begin) {
-      if(!Record::db.add(dest.path().withChild(s + cnt), *begin)) {
+      const Path target = dest.path().withChild(s + cnt);
+      const string value = Value::encodeString(*begin);
+      if(!Record::db->add(target, value)) {
         throw janosh_exception() << record_info({"Failed to add target", dest});
       }
+      Record::written(target, value);
       ++cnt;
     }
 
@@ -741,68 +1780,108 @@ namespace janosh {
       throw janosh_exception() << record_info({"append is limited to directories", dest});
     }
 
+    Transaction txn(*Record::db);
     src.fetch();
     dest.fetch();
 
-    size_t n = src.getSize();
-    size_t s = dest.getSize();
-    size_t cnt = 0;
-    string path;
-    string value;
+    if(!dest.isArray() && !dest.isObject()) {
+      throw janosh_exception() << record_info({"can't append to a value", dest});
+    }
 
-    for(; cnt < n; ++cnt) {
-      if(cnt > 0)
-        src.next();
+    const string destKey = dest.path().key();
+    string prefix;
+    string start;
+    size_t n;
+
+    if(src.isSlice()) {
+      // the members of the source array selected by the slice
+      string end;
+      prefix = src.path().basePath().key() + '/';
+      n = src.range(start, end);
 
-      src.read();
-      if(src.isAncestorOf(dest)) {
+      if(destKey.compare(0, prefix.size(), prefix) == 0 && destKey != prefix + '!') {
         throw janosh_exception() << record_info({"can't append an ancestor", src});
       }
+    } else if(src.isRange()) {
+      // all children of the source directory
+      prefix = src.path().basePath().key() + '/';
+      start = prefix;
+      n = src.getSize();
 
-      if(src.isDirectory()) {
-        Record target;
-        if(dest.isObject()) {
-          target = dest.path().withChild(src.path().name()).asDirectory();
-        } else if(dest.isArray()) {
-          target = dest.path().withChild(s + cnt).asDirectory();
-        } else {
-          throw janosh_exception() << record_info({"can't append to a value", dest});
-        }
+      if(destKey.compare(0, prefix.size(), prefix) == 0 && destKey != prefix + '!') {
+        throw janosh_exception() << record_info({"can't append an ancestor", src});
+      }
+    } else {
+      // the source record alone
+      const Path base = src.path().basePath();
+      prefix = base.parent().basePath().key() + '/';
+      start = base.key();
+      n = 1;
 
-        if(src.isAncestorOf(target)) {
+      if(src.isDirectory()) {
+        start += '/';
+        if(destKey.compare(0, start.size(), start) == 0) {
           throw janosh_exception() << record_info({"can't append an ancestor", src});
         }
+      }
+    }
 
-        if(!makeDirectory(target, src.getType())) {
-          throw janosh_exception() << record_info({"failed to create directory", target});
-        }
+    size_t s = dest.getSize();
+    size_t cnt = appendRange(prefix, start, n, dest, s);
+    setContainerSize(dest, s + cnt);
+    txn.commit();
+    return cnt;
+  }
 
-        Record wildcard = src.path().asWildcard();
-        if(!append(wildcard, target)) {
-          throw janosh_exception() << record_info({"failed to append values", target});
-        }
-      } else {
-        if(dest.isArray()) {
-          Path target = dest.path().withChild(s + cnt);
-          if(!Record::db.add(
-              target,
-              src.value()
-          )) {
-            throw janosh_exception() << record_info({"add failed", target});
-          }
-        } else if(dest.isObject()) {
-          Path target = dest.path().withChild(src.path().name());
-          if(!Record::db.add(
-              target,
-              src.value()
-          )) {
-            throw janosh_exception() << record_info({"add failed",target});
-          }
-        }
+  /**
+   * Copies a range of directory members below a destination directory in one ordered pass.
+   * Every record below a member is written with its key prefix rewritten to the destination,
+   * members appended to an array are renumbered starting at the given offset.
+   * Doesn't update the size of the destination directory.
+   * @param prefix the key prefix of the source directory.
+   * @param start the key to start streaming at.
+   * @param n the maximum number of members to copy.
+   * @param dest the destination directory.
+   * @param offset index of the first member when appending to an array.
+   * @return number of copied members.
+   */
+  size_t Janosh::appendRange(const string& prefix, const string& start, const size_t n, Record& dest, const size_t offset) {
+    boost::scoped_ptr<Engine::Cursor> cur(Record::db->cursor());
+    const string header = prefix + '!';
+    const bool array = dest.isArray();
+    string key, value, member, target;
+    size_t cnt = 0;
+
+    cur->jump(start);
+    while(cur->get(&key, &value, true)) {
+      if(key.compare(0, prefix.size(), prefix) != 0)
+        break;
+
+      if(key == header)
+        continue;
+
+      const size_t end = key.find('/', prefix.size());
+      const size_t len = (end == string::npos ? key.size() : end) - prefix.size();
+
+      if(cnt == 0 || key.compare(prefix.size(), len, member) != 0) {
+        if(cnt == n)
+          break;
+
+        member = key.substr(prefix.size(), len);
+        if(array)
+          target = dest.path().withChild(offset + cnt).key();
+        else
+          target = dest.path().withChild(Component(member)).key();
+        ++cnt;
+      }
+
+      const string destKey = target + key.substr(prefix.size() + len);
+      if(!Record::db->add(destKey, value)) {
+        throw janosh_exception() << record_info({"add failed", Record(destKey)});
       }
+      Record::written(destKey, value);
     }
 
-    setContainerSize(dest, s + cnt);
     return cnt;
   }
 
@@ -826,17 +1905,28 @@ namespace janosh {
       throw janosh_exception() << record_info({"invalid target", dest});
     }
 
-    if((src.isRange() || src.isDirectory()) && !dest.exists()) {
+    if(src.isSlice() && !dest.isDirectory()) {
+      throw janosh_exception() << record_info({"a slice can only be copied to a directory", dest});
+    }
+
+    Transaction txn(*Record::db);
+    size_t cnt;
+    if(src.isSlice()) {
+      if(!dest.exists())
+        makeDirectory(dest, Value::Array);
+      cnt = this->append(src, dest);
+    } else if((src.isRange() || src.isDirectory()) && !dest.exists()) {
       makeDirectory(dest, src.getType());
       Record wildcard = src.path().asWildcard();
-      return this->append(wildcard, dest);
+      cnt = this->append(wildcard, dest);
     } else if (src.isValue() && dest.isValue()) {
-      return this->set(dest, src.value());
+      cnt = this->set(dest, src.value());
     } else {
-      return this->append(src, dest);
+      cnt = this->append(src, dest);
     }
 
-    return 0;
+    txn.commit();
+    return cnt;
   }
 
   size_t Janosh::shift(Record& src, Record& dest) {
@@ -857,6 +1947,7 @@ namespace janosh {
       throw janosh_exception() << record_info({"index out of bounds", src});
     }
 
+    Transaction txn(*Record::db);
     bool back = srcIndex > destIndex;
     Record forwardRec = src.clone().fetch();
     Record backRec = src.clone().fetch();
@@ -894,6 +1985,7 @@ namespace janosh {
     remove(tmp);
     Record tmpDir("/tmp/.");
     remove(tmpDir);
+    txn.commit();
     src = dest;
 
     return 1;
@@ -902,54 +1994,76 @@ namespace janosh {
   void Janosh::setContainerSize(Record container, const size_t s) {
     JANOSH_TRACE({container}, s);
 
-    string containerValue;
-    string strContainer;
     const Value::Type& containerType = container.getType();
-    char t;
-
-    if (containerType == Value::Array)
-     t = 'A';
-    else if (containerType == Value::Object)
-     t = 'O';
-    else
-     assert(false);
-
-    const string& new_value =
-       (boost::format("%c%d") % t % (s)).str();
+    assert(containerType == Value::Array || containerType == Value::Object);
 
-    container.setValue(new_value);
+    container.setValue(Value::encodeContainer(containerType, s));
   }
 
   void Janosh::changeContainerSize(Record container, const size_t by) {
-    container.fetch();
-    setContainerSize(container, container.getSize() + by);
+    DirectoryCache::Entry dir;
+    if(!directory(container.path(), dir))
+      throw janosh_exception() << record_info({"Directory not found", container});
+
+    const string key = container.path().asDirectory().key();
+    const string value = Value::encodeContainer(dir.type, dir.size + by);
+    if(!Record::db->replace(key, value))
+      throw db_exception() << record_info({"failed to update directory size", container});
+    Record::written(key, value);
   }
 
-  size_t Janosh::load(const Path& path, const string& value) {
-    return Record::db.set(path, value) ? 1 : 0;
+  size_t Janosh::load(const Path& path, const string& value, Run* run) {
+    if(run) {
+      run->push_back({path.key(), value});
+      return 1;
+    }
+
+    if(!Record::db->set(path, value))
+      return 0;
+
+    Record::written(path, value);
+    return 1;
   }
 
-  size_t Janosh::load(js::Value& v, Path& path) {
+  size_t Janosh::load(js::Value& v, Path& path, Run* run) {
     size_t cnt = 0;
     if (v.type() == js::obj_type) {
-      cnt+=load(v.get_obj(), path);
+      cnt+=load(v.get_obj(), path, run);
     } else if (v.type() == js::array_type) {
-      cnt+=load(v.get_array(), path);
+      cnt+=load(v.get_array(), path, run);
+    } else if (v.type() == js::str_type) {
+      cnt+=this->load(path, Value::encodeString(v.get_str()), run);
+    } else if (v.type() == js::int_type) {
+      cnt+=this->load(path, Value::encodeInteger(v.get_int64()), run);
+    } else if (v.type() == js::real_type) {
+      cnt+=this->load(path, Value::encodeReal(v.get_real()), run);
+    } else if (v.type() == js::bool_type) {
+      cnt+=this->load(path, Value::encodeBoolean(v.get_bool()), run);
     } else {
-      cnt+=this->load(path, v.get_str());
+      cnt+=this->load(path, Value::encodeNull(), run);
     }
     return cnt;
   }
 
-  size_t Janosh::load(js::Object& obj, Path& path) {
+  /**
+   * @return the number of members of a JSON object, members of the same name count once as they are stored as one.
+   */
+  static size_t distinctMembers(const js::Object& obj) {
+    std::set<string> names;
+    for(const js::Pair& p : obj)
+      names.insert(p.name_);
+    return names.size();
+  }
+
+  size_t Janosh::load(js::Object& obj, Path& path, Run* run) {
     size_t cnt = 0;
     path.pushMember(".");
-    cnt+=this->load(path, (boost::format("O%d") % obj.size()).str());
+    cnt+=this->load(path, Value::encodeContainer(Value::Object, distinctMembers(obj)), run);
     path.pop();
 
     BOOST_FOREACH(js::Pair& p, obj) {
       path.pushMember(p.name_);
-      cnt+=load(p.value_, path);
+      cnt+=load(p.value_, path, run);
       path.pop();
       ++cnt;
     }
@@ -957,16 +2071,16 @@ namespace janosh {
     return cnt;
   }
 
-  size_t Janosh::load(js::Array& array, Path& path) {
+  size_t Janosh::load(js::Array& array, Path& path, Run* run) {
     size_t cnt = 0;
     int index = 0;
     path.pushMember(".");
-    cnt+=this->load(path, (boost::format("A%d") % array.size()).str());
+    cnt+=this->load(path, Value::encodeContainer(Value::Array, array.size()), run);
     path.pop();
 
     BOOST_FOREACH(js::Value& v, array){
       path.pushIndex(index++);
-      cnt+=load(v, path);
+      cnt+=load(v, path, run);
       path.pop();
       ++cnt;
     }
@@ -974,12 +2088,30 @@ namespace janosh {
   }
 
   bool Janosh::boundsCheck(Record p) {
-    Record parent = p.parent();
+    const Path parent = p.path().parent();
+    DirectoryCache::Entry dir;
 
-    p.fetch();
-    parent.fetch();
+    return (parent.isRoot() || !directory(parent, dir) || dir.type != Value::Array || p.path().parseIndex() <= dir.size);
+  }
+
+  /**
+   * Looks up type and size of a directory, reading its header only if it isn't cached yet.
+   * @param dir the path of the directory.
+   * @param entry receives type and size.
+   * @return false if the directory doesn't exist.
+   */
+  bool Janosh::directory(const Path& dir, DirectoryCache::Entry& entry) {
+    const Path header = dir.asDirectory();
+    if(Record::directories.find(header.key(), entry))
+      return true;
+
+    Record rec(header);
+    if(!rec.fetch().exists())
+      return false;
 
-    return (parent.path().isRoot() || (!parent.isArray() || p.path().parseIndex() <= parent.getSize()));
+    entry = { rec.value().getType(), rec.getSize() };
+    Record::directories.put(header.key(), entry);
+    return true;
   }
 
 
@@ -995,7 +2127,11 @@ std::vector<size_t> sequence() {
   return v;
 }
 
-kyotocabinet::TreeDB janosh::Record::db;
+janosh::Engine* janosh::Record::db = NULL;
+janosh::UpdateLog janosh::Record::log;
+janosh::IndexSet janosh::Record::indexes;
+janosh::RecordCache janosh::Record::cache;
+janosh::DirectoryCache janosh::Record::directories;
 
 void printUsage() {
     std::cerr << "janosh [options] <command> <paths...>" << endl
@@ -1004,8 +2140,15 @@ void printUsage() {
         << "  -v                enable verbose output" << endl
         << "  -j                output json format" << endl
         << "  -b                output bash format" << endl
+        << "  -f <format>       output format: bash, json, raw, msgpack or lines" << endl
         << "  -t                execute triggers for corresponding paths" << endl
         << "  -e <target list>  execute given targets" << endl
+        << "  -s, --snapshot <file>  serve reads from a snapshot file" << endl
+        << "  -p, --threads <n>      export and aggregate directories with n threads, 0 for one per core" << endl
+        << "  --binary               export and import in the binary backup format" << endl
+        << "  --offset <n>           get skips the first n members of a directory" << endl
+        << "  --limit <n>            get prints at most n members of a directory" << endl
+        << "  --tail <n>             get prints the last n members of a directory" << endl
         << endl
         << "Commands: " << endl
         <<  "  load" << endl
@@ -1024,10 +2167,34 @@ void printUsage() {
         <<  "  mkarr" << endl
         <<  "  mkobj" << endl
         <<  "  hash" << endl
+        <<  "  follow            (the update log is never truncated, remove it while no follower is behind)" << endl
+        <<  "  snapshot" << endl
+        <<  "  export" << endl
+        <<  "  import" << endl
+        <<  "  index" << endl
+        <<  "  lookup" << endl
+        <<  "  agg" << endl
+        <<  "  defrag" << endl
+        <<  "  sync" << endl
+        <<  "  migrate" << endl
         << endl;
       exit(0);
 }
 
+/**
+ * Reads the number given to an option.
+ * @param option the name of the option, for the error message.
+ * @param arg the argument of the option.
+ * @return the number, which can't be negative.
+ */
+size_t parseCount(const string& option, const char* arg) {
+  const string s(arg);
+  if(s.empty() || s.find_first_not_of("0123456789") != string::npos)
+    throw janosh::janosh_exception() << janosh::string_info({"Expected a non-negative number for " + option, s});
+
+  return boost::lexical_cast<size_t>(s);
+}
+
 int main(int argc, char** argv) {
   using namespace std;
   using namespace boost;
@@ -1037,7 +2204,8 @@ int main(int argc, char** argv) {
   TRI_LOG_OFF();
 
   size_t result = -1;
-  Janosh* janosh;
+  // options are parsed before the instance exists and may throw
+  Janosh* janosh = NULL;
    try {
 
      std::vector<string> args;
@@ -1055,10 +2223,44 @@ int main(int argc, char** argv) {
      string key;
      string value;
      string targetList;
+     string snapshotFile;
      char* const* c_args = argv;
+     size_t threads = 1;
+     bool binary = false;
+     size_t offset = 0;
+     size_t limit = -1;
+     bool tail = false;
+     static struct option longOptions[] = {
+         { "snapshot", required_argument, 0, 's' },
+         { "threads", required_argument, 0, 'p' },
+         { "binary", no_argument, 0, 'B' },
+         { "offset", required_argument, 0, 'O' },
+         { "limit", required_argument, 0, 'L' },
+         { "tail", required_argument, 0, 'T' },
+         { 0, 0, 0, 0 }
+     };
      optind=1;
-     while ((c = getopt(argc, c_args, "vfjbrthe:")) != -1) {
+     while ((c = getopt_long(argc, c_args, "vf:jbrthe:s:p:", longOptions, NULL)) != -1) {
        switch (c) {
+       case 's':
+         snapshotFile = optarg;
+         break;
+       case 'p':
+         threads = parseCount("--threads", optarg);
+         break;
+       case 'B':
+         binary = true;
+         break;
+       case 'O':
+         offset = parseCount("--offset", optarg);
+         break;
+       case 'L':
+         limit = parseCount("--limit", optarg);
+         break;
+       case 'T':
+         limit = parseCount("--tail", optarg);
+         tail = true;
+         break;
        case 'f':
          if(string(optarg) == "bash")
            f=janosh::Bash;
@@ -1066,6 +2268,10 @@ int main(int argc, char** argv) {
            f=janosh::Json;
          else if(string(optarg) == "raw")
            f=janosh::Raw;
+         else if(string(optarg) == "msgpack")
+           f=janosh::Msgpack;
+         else if(string(optarg) == "lines")
+           f=janosh::Lines;
           else
             throw janosh_exception() << string_info({"Illegal format", string(optarg)});
          break;
@@ -1102,14 +2308,30 @@ int main(int argc, char** argv) {
      janosh = new Janosh();
 
      janosh->setFormat(f);
+     janosh->setThreads(threads);
+     janosh->setBinary(binary);
+     janosh->setPage(offset, limit, tail);
+
+     if(!snapshotFile.empty()) {
+       janosh->settings_.engine = "snapshot";
+       janosh->settings_.databaseFile = snapshotFile;
+     }
 
      vector<std::string> vecArgs;
 
      if(argc >= optind + 1) {
        LOG_DEBUG_MSG("Execute command", argv[optind]);
        string strCmd = string(argv[optind]);
-       if(strCmd == "get") {
+       if(!snapshotFile.empty()) {
+         if(strCmd != "get" && strCmd != "size" && strCmd != "dump" && strCmd != "hash")
+           throw janosh_exception() << string_info({"Snapshots are read only", strCmd});
          janosh->open(true);
+       } else if(strCmd == "get" || strCmd == "snapshot" || strCmd == "export" || strCmd == "lookup" || strCmd == "agg") {
+         janosh->open(true);
+       } else if(strCmd == "follow") {
+         // the follower only reads the update log and never locks the primary database
+       } else if(strCmd == "defrag") {
+         // defrag opens the database as a writer for each burst itself, so readers get in between
        } else {
          janosh->open(false);
        }
@@ -1137,7 +2359,8 @@ int main(int argc, char** argv) {
 
      janosh->close();
 
-     if(execTriggers) {
+     // a failed command wrote nothing, a failed multi-pair write rolled back all pairs
+     if(execTriggers && result == 0) {
        LOG_DEBUG("Triggers");
        Command* t = janosh->cm["trigger"];
        vector<string> vecTriggers;
@@ -1161,13 +2384,15 @@ int main(int argc, char** argv) {
      }
 
    } catch(janosh_exception& ex) {
-     janosh->printException(ex);
+     Janosh::printException(ex);
      result = 1;
    } catch(std::exception& ex) {
-     janosh->printException(ex);
+     Janosh::printException(ex);
      result = 1;
    }
-   janosh->close();
+
+   if(janosh)
+     janosh->close();
    return result;
 }
 
@@ -2,6 +2,7 @@
 #define _JANOSH_HPP
 
 #include <map>
+#include <queue>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -25,12 +26,18 @@
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-#include <kcpolydb.h>
 
 #include "logger.hpp"
 #include "record.hpp"
+#include "snapshot.hpp"
+#include "backup.hpp"
+#include "filter.hpp"
+#include "aggregate.hpp"
+#include "taskpool.hpp"
 #include "json_spirit/json_spirit.h"
 #include "json.hpp"
+#include "msgpack.hpp"
+#include "lines.hpp"
 #include "bash.hpp"
 
   namespace kc = kyotocabinet;
@@ -50,7 +57,9 @@ namespace janosh {
   enum Format {
     Bash,
     Json,
-    Raw
+    Raw,
+    Msgpack,
+    Lines
   };
 
   class TriggerBase {
@@ -85,6 +94,11 @@ public:
     fs::path databaseFile;
     fs::path triggerFile;
     fs::path logFile;
+    fs::path updateLogFile;
+    string engine;
+    Tuning tuning;
+    Durability durability;
+    size_t cacheBudget;
     vector<fs::path> triggerDirs;
 
     Settings();
@@ -110,8 +124,11 @@ public:
     ~Janosh();
 
     void setFormat(Format f) ;
-    void printException(janosh_exception& ex);
-    void printException(std::exception& ex);
+    void setThreads(size_t n);
+    void setBinary(bool b);
+    void setPage(size_t offset, size_t limit, bool tail);
+    static void printException(janosh_exception& ex);
+    static void printException(std::exception& ex);
     void open(bool readOnly);
     void close();
     size_t process(int argc, char** argv);
@@ -122,13 +139,21 @@ public:
     size_t makeArray(Record target, size_t size = 0, bool boundsCheck=true);
     size_t makeObject(Record target, size_t size = 0);
     size_t makeDirectory(Record target, Value::Type type, size_t size = 0);
-    size_t get(Record target, std::ostream& out);
+    size_t get(Record target, std::ostream& out, const Filter* filter = NULL);
+    size_t get(const vector<string>& paths, std::ostream& out, const Filter* filter = NULL);
+    size_t aggregate(const string& op, const string& pattern, std::ostream& out);
     size_t size(Record target);
     size_t remove(Record& target, bool pack=true);
 
     size_t add(Record target, const string& value);
+    size_t add(Record target, const Value& value);
     size_t replace(Record target, const string& value);
+    size_t replace(Record target, const Value& value);
     size_t set(Record target, const string& value);
+    size_t set(Record target, const Value& value);
+    size_t add(vector<string>::const_iterator begin, vector<string>::const_iterator end);
+    size_t replace(vector<string>::const_iterator begin, vector<string>::const_iterator end);
+    size_t set(vector<string>::const_iterator begin, vector<string>::const_iterator end);
     size_t append(Record target, const string& value);
     size_t append(vector<string>::const_iterator begin, vector<string>::const_iterator end, Record dest);
 
@@ -141,8 +166,20 @@ public:
     size_t dump();
     size_t hash();
     size_t truncate();
+    size_t migrate();
+    size_t follow(const fs::path& followerFile, size_t interval, std::ostream& out);
+    size_t snapshot(const fs::path& snapshotFile);
+    size_t exportFile(const fs::path& file);
+    size_t importFile(const fs::path& file);
+    size_t defrag(int64_t step, size_t pause);
+    size_t sync();
   private:
     Format format;
+    size_t threads;
+    bool binary;
+    size_t offset;
+    size_t limit;
+    bool tail;
 
     bool open_;
 
@@ -157,80 +194,276 @@ public:
 
     void setContainerSize(Record rec, const size_t s);
     void changeContainerSize(Record rec, const size_t by);
-
-    size_t load(const Path& path, const string& value);
-    size_t load(js::Value& v, Path& path);
-    size_t load(js::Object& obj, Path& path);
-    size_t load(js::Array& array, Path& path);
+    size_t removeSubtree(Record& dir);
+    size_t removeSlice(Record& slice);
+    size_t rename(const string& from, const string& to, bool subtree);
+    size_t pack(Record& array);
+    size_t appendRange(const string& prefix, const string& start, const size_t n, Record& dest, const size_t offset);
+    size_t writePairs(vector<string>::const_iterator begin, vector<string>::const_iterator end, bool create, bool overwrite);
+
+    typedef vector<std::pair<string, string> > Run;
+
+    size_t load(const Path& path, const string& value, Run* run = NULL);
+    size_t load(js::Value& v, Path& path, Run* run = NULL);
+    size_t load(js::Object& obj, Path& path, Run* run = NULL);
+    size_t load(js::Array& array, Path& path, Run* run = NULL);
+    size_t loadParallel(const string& doc);
     bool boundsCheck(Record p);
+    bool directory(const Path& dir, DirectoryCache::Entry& entry);
     Record makeTemp(const Value::Type& t);
+    vector<string> memberKeys(const string& prefix);
+    vector<std::pair<string, string> > memberRanges(const string& prefix, size_t workers);
+    size_t selectMembers(Record& dir, const Filter* filter, size_t from, size_t to, vector<std::pair<string, string> >& ranges);
+    bool isPaged() const;
+    void page(const size_t n, size_t& first, size_t& count) const;
+
+    struct Container {
+      size_t depth;
+      Value::Type type;
+      bool empty;
+    };
 
     template<typename Tvisitor>
      size_t recurse(Record& travRoot, Tvisitor vis)  {
-       size_t cnt = 0;
-       std::stack<std::pair<const Component, const Value::Type> > hierachy;
-       Record root("/.");
+       std::stack<Container> hierachy;
+       const string prefix = travRoot.path().basePath().key() + '/';
 
        Record rec(travRoot);
        vis.begin();
+       size_t cnt = traverse(rec, prefix, "", hierachy, vis);
+       closeContainers(hierachy, 0, vis);
+       vis.close();
+       return cnt;
+     }
 
-       Path last;
+    /**
+     * Visits the records starting at the current position of rec, in key order.
+     * Stops at the first record outside of the key prefix, at the end key, or once all containers are closed.
+     * Stepping the record only decodes the components of each key that differ from the previous key.
+     * @param rec the record to start with. Is moved forward.
+     * @param prefix the key prefix of the traversed directory.
+     * @param end the key to stop at. Empty for no limit.
+     * @param hierachy the containers opened and not closed yet.
+     * @param vis the visitor.
+     * @return number of visited records.
+     */
+    template<typename Tvisitor>
+     size_t traverse(Record& rec, const string& prefix, const string& end, std::stack<Container>& hierachy, Tvisitor& vis)  {
+       size_t cnt = 0;
        do {
          rec.fetch();
          const Path& path = rec.path();
+
+         if (cnt > 0 && hierachy.empty())
+           break;
+
+         if (path.key().compare(0, prefix.size(), prefix) != 0 || (!end.empty() && path.key() >= end))
+           break;
+
          const Value& value = rec.value();
          const Value::Type& t = rec.getType();
-         const Path& parent = path.parent();
-
-         const Component& name = path.name();
-         const Component& parentName = parent.name();
+         const size_t parentDepth = path.depth() - (path.isDirectory() ? 2 : 1);
 
-         if (!hierachy.empty()) {
-           if (!travRoot.isAncestorOf(path)) {
-             break;
+         while(!hierachy.empty() && hierachy.top().depth > parentDepth) {
+           if (hierachy.top().type == Value::Array) {
+             vis.endArray(path);
+           } else if (hierachy.top().type == Value::Object) {
+             vis.endObject(path);
            }
+           hierachy.pop();
+         }
 
-           if(!last.above(path) && (
-               (!last.isDirectory() && parentName != last.parentName()) ||
-               (last.isDirectory() && parentName != last.name()))){
-             while(!hierachy.empty() && hierachy.top().first != parentName) {
-               if (hierachy.top().second == Value::Array) {
-                 vis.endArray(path);
-               } else if (hierachy.top().second == Value::Object) {
-                 vis.endObject(path);
-               }
-               hierachy.pop();
-             }
-           }
+         bool first = true;
+         bool array = false;
+         if(!hierachy.empty()) {
+           first = hierachy.top().empty;
+           array = hierachy.top().type == Value::Array;
+           hierachy.top().empty = false;
          }
 
          if (t == Value::Array) {
-           hierachy.push({name, Value::Array});
-           vis.beginArray(path, last.isEmpty() || last == parent);
+           hierachy.push({path.depth() - 1, Value::Array, true});
+           vis.beginArray(path, value, array, first);
          } else if (t == Value::Object) {
-           hierachy.push({name, Value::Object});
-           vis.beginObject(path, last.isEmpty() || last == parent);
+           hierachy.push({path.depth() - 1, Value::Object, true});
+           vis.beginObject(path, value, array, first);
          } else {
-           bool first = last.isEmpty() || last == parent;
-           if(!hierachy.empty()){
-             vis.record(path, value, hierachy.top().second == Value::Array, first);
-           } else {
-             vis.record(path, value, false, first);
-           }
+           vis.record(path, value, array, first);
          }
-         last = path;
          ++cnt;
        } while (rec.step());
 
-       while (!hierachy.empty()) {
-           if (hierachy.top().second == Value::Array) {
+       return cnt;
+     }
+
+    /**
+     * Like recurse but only visits selected members of the directory.
+     * The directory is visited with the number of selected members as its size.
+     * Members outside of the ranges are skipped without being read.
+     * @param travRoot the directory to traverse.
+     * @param ranges the key ranges of the selected members, see selectMembers.
+     * @param size the number of selected members.
+     * @param vis the visitor.
+     * @return number of visited records.
+     */
+    template<typename Tvisitor>
+     size_t recurseMembers(Record& travRoot, const vector<std::pair<string, string> >& ranges, const size_t size, Tvisitor vis)  {
+       std::stack<Container> hierachy;
+       const string prefix = travRoot.path().basePath().key() + '/';
+       const Value::Type type = travRoot.getType();
+       const Value header(Value::encodeContainer(type, size), true);
+       const Path& path = travRoot.path();
+       vis.begin();
+       hierachy.push({path.depth() - 1, type, true});
+       if(type == Value::Array)
+         vis.beginArray(path, header, false, true);
+       else
+         vis.beginObject(path, header, false, true);
+
+       size_t cnt = 1;
+       for(const std::pair<string, string>& r : ranges) {
+         Record part = Record(Path(r.first));
+         cnt += traverse(part, prefix, r.second, hierachy, vis);
+       }
+
+       closeContainers(hierachy, 0, vis);
+       vis.close();
+       return cnt;
+     }
+
+    /**
+     * Visits the leaves starting at the current position of rec, in key order.
+     * Directory records are stepped over without reading their values and no containers are tracked.
+     * @param rec the record to start with. Is moved forward.
+     * @param prefix the key prefix of the traversed directory.
+     * @param end the key to stop at. Empty for no limit.
+     * @param vis the visitor.
+     * @return number of visited leaves.
+     */
+    template<typename Tvisitor>
+     size_t traverseLeaves(Record& rec, const string& prefix, const string& end, Tvisitor& vis)  {
+       size_t cnt = 0;
+       rec.fetch();
+       if (!rec.exists())
+         return 0;
+
+       do {
+         const Path& path = rec.path();
+         if (path.key().compare(0, prefix.size(), prefix) != 0 || (!end.empty() && path.key() >= end))
+           break;
+
+         if (!path.isDirectory()) {
+           if (!rec.hasData())
+             rec.readValue();
+           vis.record(path, rec.value(), false, cnt == 0);
+           ++cnt;
+         }
+       } while (rec.step());
+
+       return cnt;
+     }
+
+    /**
+     * Writes the leaves below a directory with a line based visitor.
+     * With more than one thread the directory is split at its members like in recurseParallel.
+     * @param travRoot the directory to traverse.
+     * @param out the stream to write to.
+     * @return number of visited leaves.
+     */
+    template<typename Tvisitor>
+     size_t recurseLeaves(Record& travRoot, std::ostream& out)  {
+       const string prefix = travRoot.path().basePath().key() + '/';
+       Tvisitor vis(out);
+       vis.begin();
+
+       TaskPool pool(this->threads);
+       const vector<std::pair<string, string> > ranges = memberRanges(prefix, pool.size());
+       const size_t tasks = ranges.size();
+       size_t cnt = 0;
+
+       if(tasks < 2) {
+         Record rec(travRoot);
+         cnt = traverseLeaves(rec, prefix, "", vis);
+       } else {
+         vector<boost::shared_ptr<std::stringstream> > buffers(tasks);
+         vector<size_t> counts(tasks, 0);
+
+         pool.run(tasks, [&](size_t t) {
+           buffers[t].reset(new std::stringstream());
+           Tvisitor partVis(*buffers[t]);
+           Record part = Record(Path(ranges[t].first));
+           counts[t] = traverseLeaves(part, prefix, ranges[t].second, partVis);
+         });
+
+         for(size_t t = 0; t < tasks; ++t) {
+           if(buffers[t]->tellp() > 0)
+             out << buffers[t]->rdbuf();
+           cnt += counts[t];
+         }
+       }
+
+       vis.close();
+       return cnt;
+     }
+
+    template<typename Tvisitor>
+     void closeContainers(std::stack<Container>& hierachy, size_t keep, Tvisitor& vis)  {
+       while (hierachy.size() > keep) {
+           if (hierachy.top().type == Value::Array) {
              vis.endArray("");
-           } else if (hierachy.top().second == Value::Object) {
+           } else if (hierachy.top().type == Value::Object) {
              vis.endObject("");
            }
            hierachy.pop();
        }
+     }
+
+    /**
+     * Like recurse but splits the directory at its members and serializes the parts concurrently.
+     * Every part is written to its own buffer, the buffers are written out in key order.
+     * The output is identical to the output of recurse.
+     * @param travRoot the directory to traverse.
+     * @param out the stream to write to.
+     * @return number of visited records.
+     */
+    template<typename Tvisitor>
+     size_t recurseParallel(Record& travRoot, std::ostream& out)  {
+       std::stack<Container> hierachy;
+       const string prefix = travRoot.path().basePath().key() + '/';
+       TaskPool pool(this->threads);
+       const vector<std::pair<string, string> > ranges = memberRanges(prefix, pool.size());
+       const size_t tasks = ranges.size();
+       if(tasks < 2)
+         return recurse(travRoot, Tvisitor(out));
+
+       // the directory header itself
+       Tvisitor vis(out);
+       Record rec(travRoot);
+       vis.begin();
+       size_t cnt = traverse(rec, prefix, ranges.front().first, hierachy, vis);
+
+       vector<boost::shared_ptr<std::stringstream> > buffers(tasks);
+       vector<size_t> counts(tasks, 0);
+       const std::stack<Container> root = hierachy;
+
+       pool.run(tasks, [&](size_t t) {
+         std::stack<Container> h = root;
+         h.top().empty = (t == 0);
+
+         buffers[t].reset(new std::stringstream());
+         Tvisitor partVis(*buffers[t]);
+         Record part = Record(Path(ranges[t].first));
+         counts[t] = traverse(part, prefix, ranges[t].second, h, partVis);
+         closeContainers(h, root.size(), partVis);
+       });
+
+       for(size_t t = 0; t < tasks; ++t) {
+         if(buffers[t]->tellp() > 0)
+           out << buffers[t]->rdbuf();
+         cnt += counts[t];
+       }
 
+       closeContainers(hierachy, 0, vis);
        vis.close();
        return cnt;
      }
@@ -245,13 +478,13 @@ public:
         out(out) {
     }
 
-    void beginArray(const Path& p, bool first) {
+    void beginArray(const Path& p, const Value& value, bool array, bool first) {
     }
 
     void endArray(const Path& p) {
     }
 
-    void beginObject(const Path& p, bool first) {
+    void beginObject(const Path& p, const Value& value, bool array, bool first) {
     }
 
     void endObject(const Path& p) {
@@ -263,8 +496,8 @@ public:
     void close() {
     }
 
-    void record(const Path& p, const string& value, bool array, bool first) {
-      string stripped = value;
+    void record(const Path& p, const Value& value, bool array, bool first) {
+      string stripped = value.str();
       replace(stripped.begin(), stripped.end(), '\n', ' ');
       out << stripped << endl;
     }
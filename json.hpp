@@ -42,7 +42,7 @@ namespace janosh {
         out(out){
     }
 
-    void beginArray(const Path& p, bool first) {
+    void beginArray(const Path& p, const Value& value, bool array, bool first) {
       string name = p.name().pretty();
 
       if (!first) {
@@ -59,7 +59,7 @@ namespace janosh {
       this->out << " ] " << endl;
     }
 
-    void beginObject(const Path& p, bool first) {
+    void beginObject(const Path& p, const Value& value, bool array, bool first) {
       string name = p.name().pretty();
 
       if (!first) {
@@ -76,22 +76,27 @@ namespace janosh {
       this->out << " } " << endl;
     }
 
-    void record(const Path& p, const string& value, bool array, bool first) {
+    void record(const Path& p, const Value& value, bool array, bool first) {
       string name = p.name().pretty();
-      string jsonValue = escape(value);
+      string jsonValue;
+
+      if (value.getType() == Value::String)
+        jsonValue = '"' + escape(value.str()) + '"';
+      else
+        jsonValue = value.str();
 
       if (array) {
         if (!first) {
           this->out << ',' << endl;
         }
 
-        this->out << '\"' << jsonValue << '\"';
+        this->out << jsonValue;
       } else {
         if (!first) {
           this->out << ',' << endl;
         }
 
-        this->out << '"' << name << "\":\"" << jsonValue << "\"";
+        this->out << '"' << name << "\":" << jsonValue;
       }
     }
 
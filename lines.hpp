@@ -0,0 +1,68 @@
+#ifndef _JANOSH_LINES_HPP
+#define _JANOSH_LINES_HPP
+
+#include "record.hpp"
+#include <string>
+#include <iostream>
+
+using std::string;
+
+namespace janosh {
+  /**
+   * Writes every leaf on its own line: the path, a tab and the value.
+   * Backslashes, tabs and line breaks in the value are escaped as \\, \t, \n and \r.
+   * Containers produce no output.
+   */
+  class LinesPrintVisitor {
+    std::ostream& out;
+
+    void escape(const string& s) {
+      size_t start = 0;
+      for (size_t i = 0; i < s.size(); ++i) {
+        char e;
+        switch (s[i]) {
+          case '\\': e = '\\'; break;
+          case '\t': e = 't'; break;
+          case '\n': e = 'n'; break;
+          case '\r': e = 'r'; break;
+          default: continue;
+        }
+        out.write(s.data() + start, i - start);
+        out.put('\\');
+        out.put(e);
+        start = i + 1;
+      }
+      out.write(s.data() + start, s.size() - start);
+    }
+  public:
+    LinesPrintVisitor(std::ostream& out) :
+        out(out) {
+    }
+
+    void beginArray(const Path& p, const Value& value, bool array, bool first) {
+    }
+
+    void endArray(const Path& p) {
+    }
+
+    void beginObject(const Path& p, const Value& value, bool array, bool first) {
+    }
+
+    void endObject(const Path& p) {
+    }
+
+    void begin() {
+    }
+
+    void close() {
+    }
+
+    void record(const Path& p, const Value& value, bool array, bool first) {
+      out << p.pretty() << '\t';
+      escape(value.str());
+      out << '\n';
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef _JANOSH_MSGPACK_HPP
+#define _JANOSH_MSGPACK_HPP
+
+#include "record.hpp"
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+using std::string;
+
+namespace janosh {
+  /**
+   * Writes records as MessagePack.
+   * Containers are written with the size stored in their directory header, so nothing is buffered and closing is free.
+   * Object members are written as a name followed by the value, the top level record is written without a name.
+   */
+  class MsgpackPrintVisitor {
+    std::ostream& out;
+    bool top;
+
+    void put(const unsigned char c) {
+      out.put(c);
+    }
+
+    void putBig(const unsigned char tag, uint64_t v, const size_t bytes) {
+      char buf[9];
+      buf[0] = tag;
+      for(size_t i = bytes; i > 0; --i) {
+        buf[i] = v & 0xff;
+        v >>= 8;
+      }
+      out.write(buf, bytes + 1);
+    }
+
+    void putString(const string& s) {
+      const size_t len = s.size();
+      if (len < 32)
+        put(0xa0 | len);
+      else if (len <= 0xff)
+        putBig(0xd9, len, 1);
+      else if (len <= 0xffff)
+        putBig(0xda, len, 2);
+      else
+        putBig(0xdb, len, 4);
+      out.write(s.data(), len);
+    }
+
+    void putInteger(const int64_t i) {
+      if (i >= 0) {
+        if (i < 128)
+          put(i);
+        else if (i <= 0xff)
+          putBig(0xcc, i, 1);
+        else if (i <= 0xffff)
+          putBig(0xcd, i, 2);
+        else if (i <= 0xffffffffLL)
+          putBig(0xce, i, 4);
+        else
+          putBig(0xcf, i, 8);
+      } else {
+        if (i >= -32)
+          put(static_cast<unsigned char>(i));
+        else if (i >= -128)
+          putBig(0xd0, static_cast<uint8_t>(i), 1);
+        else if (i >= -32768)
+          putBig(0xd1, static_cast<uint16_t>(i), 2);
+        else if (i >= -2147483648LL)
+          putBig(0xd2, static_cast<uint32_t>(i), 4);
+        else
+          putBig(0xd3, i, 8);
+      }
+    }
+
+    void putContainer(const unsigned char fix, const unsigned char tag16, const size_t size) {
+      if (size < 16)
+        put(fix | size);
+      else if (size <= 0xffff)
+        putBig(tag16, size, 2);
+      else
+        putBig(tag16 + 1, size, 4);
+    }
+
+    void putName(const Path& p, bool array) {
+      if (top)
+        top = false;
+      else if (!array)
+        putString(p.name().pretty());
+    }
+  public:
+    MsgpackPrintVisitor(std::ostream& out) :
+        out(out), top(false) {
+    }
+
+    void beginArray(const Path& p, const Value& value, bool array, bool first) {
+      putName(p, array);
+      putContainer(0x90, 0xdc, value.getSize());
+    }
+
+    void endArray(const Path& p) {
+    }
+
+    void beginObject(const Path& p, const Value& value, bool array, bool first) {
+      putName(p, array);
+      putContainer(0x80, 0xde, value.getSize());
+    }
+
+    void endObject(const Path& p) {
+    }
+
+    void record(const Path& p, const Value& value, bool array, bool first) {
+      putName(p, array);
+
+      switch (value.getType()) {
+        case Value::Integer:
+          putInteger(value.getInteger());
+          break;
+        case Value::Real: {
+          const double d = value.getReal();
+          uint64_t bits;
+          memcpy(&bits, &d, sizeof(bits));
+          putBig(0xcb, bits, 8);
+          break;
+        }
+        case Value::Boolean:
+          put(value.getBoolean() ? 0xc3 : 0xc2);
+          break;
+        case Value::Null:
+          put(0xc0);
+          break;
+        default:
+          putString(value.str());
+      }
+    }
+
+    void begin() {
+      top = true;
+    }
+
+    void close() {
+    }
+  };
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "path.hpp"
+#include <algorithm>
 
   using namespace janosh;
   using std::string;
@@ -77,6 +78,57 @@
     }
   }
 
+  /**
+   * Points the path to another key.
+   * Components shared with the current key are kept, only the differing suffix of the key is decoded.
+   * @param k a key as stored in the database.
+   */
+  void Path::advance(const string& k) {
+    if(this->components.empty() || k.empty() || k.at(0) != '/') {
+      update(k);
+      return;
+    }
+
+    const size_t max = std::min(this->keyStr.size(), k.size());
+    size_t common = 0;
+    while(common < max && this->keyStr[common] == k[common])
+      ++common;
+
+    size_t keep = 0;
+    size_t pos = 0;
+    size_t prettyLen = 0;
+    while(keep < this->components.size()) {
+      const size_t end = pos + 1 + this->components[keep].key().size();
+      if(end > common || (end < k.size() && k[end] != '/'))
+        break;
+
+      pos = end;
+      prettyLen += 1 + this->components[keep].pretty().size();
+      ++keep;
+    }
+
+    this->components.resize(keep);
+    this->prettyStr.resize(prettyLen);
+
+    while(pos < k.size()) {
+      size_t end = k.find('/', pos + 1);
+      if(end == string::npos)
+        end = k.size();
+
+      if(end == pos + 1)
+        throw path_exception() << string_info({"illegal path", k});
+
+      this->components.push_back(Component(k.substr(pos + 1, end - pos - 1)));
+      this->prettyStr += '/';
+      this->prettyStr += this->components.back().pretty();
+      pos = end;
+    }
+
+    this->keyStr = k;
+    this->directory = !this->components.empty() && this->components.back().isDirectory();
+    this->wildcard = !this->components.empty() && this->components.back().isWildcard();
+  }
+
   bool Path::operator<(const Path& other) const {
     return this->key() < other.key();
   }
@@ -97,11 +149,11 @@
     return this->keyStr != other.keyStr;
   }
 
-  const string Path::key() const {
+  const string& Path::key() const {
     return this->keyStr;
   }
 
-  const string Path::pretty() const {
+  const string& Path::pretty() const {
     return this->prettyStr;
   }
 
@@ -109,6 +161,13 @@
     return this->wildcard;
   }
 
+  /**
+   * @return true if the last component is an array slice like #10:#20.
+   */
+  const bool Path::isSlice() const {
+    return !this->components.empty() && this->components.back().isSlice();
+  }
+
   const bool Path::isDirectory() const {
     return this->directory;
   }
@@ -155,6 +214,8 @@
   Path Path::basePath() const {
     if(isDirectory() || isWildcard()) {
       return Path(this->keyStr.substr(0, this->keyStr.size() - 2));
+    } else if(isSlice()) {
+      return Path(this->keyStr.substr(0, this->keyStr.size() - this->components.back().key().size() - 1));
     } else {
       return Path(*this);
     }
@@ -178,7 +239,7 @@
 
   Path Path::parent() const {
     Path parent(this->basePath());
-    if(!parent.isEmpty() && !this->isWildcard())
+    if(!parent.isEmpty() && !this->isWildcard() && !this->isSlice())
       parent.pop(false);
     parent.pushMember(".");
 
@@ -196,6 +257,13 @@
       return Component();
   }
 
+  /**
+   * @return the number of components, including a trailing directory or wildcard component.
+   */
+  size_t Path::depth() const {
+    return components.size();
+  }
+
   string Path::root() const {
     return components.front().key();
   }
@@ -9,15 +9,11 @@
 #include <boost/foreach.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/smart_ptr.hpp>
-#include <kcpolydb.h>
 #include "logger.hpp"
 #include <bitset>
 #include "exception.hpp"
 
 namespace janosh {
-  namespace kc = kyotocabinet;
-  typedef kc::DB::Cursor Cursor;
-
   struct Component {
       string _key;
       string _pretty;
@@ -31,12 +27,38 @@ namespace janosh {
         return std::bitset<std::numeric_limits<size_t>::digits>(s).to_ulong();
       }
 
+      size_t parseBound(const string& b) const {
+        if(b.at(0) == '$')
+          return keyDecodeIndex(b.substr(1));
+
+        return boost::lexical_cast<size_t>(b.at(0) == '#' ? b.substr(1) : b);
+      }
+
+      /**
+       * A slice like #10:#20 selects the array members from index 10 up to, but not including, index 20.
+       * The end may be given without the '#' or left out to select the rest of the array.
+       */
+      void initSlice(const string& begin, const string& end) {
+        const size_t b = parseBound(begin);
+        this->_key = "$" + keyEncodeIndex(b) + ":";
+        this->_pretty = "#" + boost::lexical_cast<string>(b) + ":";
+
+        if(!end.empty()) {
+          const size_t e = parseBound(end);
+          this->_key += "$" + keyEncodeIndex(e);
+          this->_pretty += "#" + boost::lexical_cast<string>(e);
+        }
+      }
+
     public:
       Component() {}
 
       Component(const string& c) {
         if(!c.empty()) {
-          if(c.at(0) == '#') {
+          const size_t colon = c.find(':');
+          if((c.at(0) == '#' || c.at(0) == '$') && colon != string::npos) {
+            initSlice(c.substr(0, colon), c.substr(colon + 1));
+          } else if(c.at(0) == '#') {
             size_t i = boost::lexical_cast<size_t>(c.substr(1));
             this->_key = "$" + keyEncodeIndex(i);
             this->_pretty = "#" + boost::lexical_cast<string>(i);
@@ -86,6 +108,25 @@ namespace janosh {
         return _pretty == "*";
       }
 
+      bool isSlice() const {
+        return !_pretty.empty() && _pretty.at(0) == '#' && _pretty.find(':') != string::npos;
+      }
+
+      size_t sliceBegin() const {
+        return boost::lexical_cast<size_t>(_pretty.substr(1, _pretty.find(':') - 1));
+      }
+
+      /**
+       * @return the index the slice ends before, or the maximum index if the slice is open ended.
+       */
+      size_t sliceEnd() const {
+        const size_t colon = _pretty.find(':');
+        if(colon + 1 == _pretty.size())
+          return std::numeric_limits<size_t>::max();
+
+        return boost::lexical_cast<size_t>(_pretty.substr(colon + 2));
+      }
+
       const string& key() const {
         return this->_key;
       }
@@ -109,6 +150,7 @@ public:
     Path(const string& strPath);
     Path(const Path& other);
     void update(const string& p);
+    void advance(const string& k);
     bool operator<(const Path& other) const;
     bool operator==(const string& other) const;
     bool operator==(const Path& other) const;
@@ -117,12 +159,14 @@ public:
     operator string() const {
       return this->key();
     }
-    const string key() const;
-    const string pretty() const;
+    const string& key() const;
+    const string& pretty() const;
     const bool isWildcard() const;
+    const bool isSlice() const;
     const bool isDirectory() const;
     bool isEmpty() const;
     bool isRoot() const;
+    size_t depth() const;
     Path asDirectory() const;
     Path asWildcard() const;
     Path withChild(const Component& c) const;
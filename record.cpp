@@ -1,10 +1,75 @@
 #include "record.hpp"
+#include <algorithm>
 
 namespace janosh {
-  typedef  boost::shared_ptr<kc::DB::Cursor> Base;
+  typedef  boost::shared_ptr<Engine::Cursor> Base;
+
+  DeferredCursor::DeferredCursor(Engine::Cursor* cur) :
+    cur(cur),
+    pending(false) {
+  }
+
+  /**
+   * Points the cursor to a key without seeking yet.
+   */
+  void DeferredCursor::defer(const string& key) {
+    target = key;
+    pending = true;
+  }
+
+  Engine::Cursor* DeferredCursor::use() {
+    if(pending) {
+      pending = false;
+      cur->jump(target);
+    }
+    return cur.get();
+  }
+
+  bool DeferredCursor::jump() {
+    pending = false;
+    return cur->jump();
+  }
+
+  bool DeferredCursor::jump(const string& key) {
+    pending = false;
+    return cur->jump(key);
+  }
+
+  bool DeferredCursor::jump_back(const string& key) {
+    pending = false;
+    return cur->jump_back(key);
+  }
+
+  bool DeferredCursor::step() {
+    return use()->step();
+  }
+
+  bool DeferredCursor::step_back() {
+    return use()->step_back();
+  }
+
+  bool DeferredCursor::get_key(string* key, bool step) {
+    return use()->get_key(key, step);
+  }
+
+  bool DeferredCursor::get_value(string* value, bool step) {
+    return use()->get_value(value, step);
+  }
+
+  bool DeferredCursor::get(string* key, string* value, bool step) {
+    return use()->get(key, value, step);
+  }
+
+  bool DeferredCursor::set_value_str(const string& value) {
+    return use()->set_value_str(value);
+  }
+
+  bool DeferredCursor::remove() {
+    return use()->remove();
+  }
 
   void Record::init(const Path path) {
-    if(path.isWildcard()) {
+    if(path.isWildcard() || path.isSlice()) {
       if(this->jump(path.asDirectory())) {
         this->doesExist = true;
         this->pathObj = path;
@@ -23,10 +88,16 @@ namespace janosh {
 
       this->doesExist = true;
     } else {
-      if(this->jump(path)) {
+      DeferredCursor* deferred = Record::cache.enabled() ? dynamic_cast<DeferredCursor*>(getCursorPtr()) : NULL;
+      if(deferred && Record::cache.find(path.key(), this->valueObj)) {
+        deferred->defer(path.key());
+        this->doesExist = true;
+      } else if(this->jump(path)) {
         this->doesExist = true;
         if(!this->readValue())
           throw record_exception() << path_info({"can't initialize", path});
+        if(deferred)
+          Record::cache.put(path.key(), this->valueObj);
       } else {
         this->doesExist = false;
       }
@@ -47,7 +118,7 @@ namespace janosh {
   }
 
   Record::Record(const Path& path) :
-    Base(Record::db.cursor()),
+    Base(Record::cache.enabled() ? new DeferredCursor(Record::db->cursor()) : Record::db->cursor()),
     pathObj(path),
     doesExist(false)
   {}
@@ -56,14 +127,14 @@ namespace janosh {
     doesExist(false){
   }
 
-  kc::DB::Cursor* Record::getCursorPtr() {
+  Engine::Cursor* Record::getCursorPtr() {
     return Base::operator->();
   }
 
   const Value::Type Record::getType()  const {
     if(this->path().isDirectory()) {
       return value().getType();
-    } else if(this->path().isWildcard()) {
+    } else if(this->path().isWildcard() || this->path().isSlice()) {
       return Value::Range;
     } else {
       return Value::String;
@@ -87,18 +158,80 @@ namespace janosh {
     if(!isInitialized())
       throw record_exception() << path_info({"uninitialized record", this->pathObj});
 
+    string k;
+    if(Record::log.isOpen() || !Record::indexes.empty() || Record::cache.enabled())
+      getCursorPtr()->get_key(&k);
+
     if(!getCursorPtr()->remove())
       throw record_exception() << path_info({"failed to remove record", this->pathObj});
 
+    Record::erased(k);
+
     this->clear();
     readPath();
   }
 
+  /**
+   * Passes a key that was set to the indexes and the update log.
+   * Has to be called for every mutation of the database, within its transaction.
+   */
+  void Record::written(const string& key, const string& value) {
+    Record::cache.invalidate(key);
+    Record::directories.written(key, value);
+    Record::indexes.set(key, value);
+    Record::log.set(key, value);
+  }
+
+  /**
+   * Passes a key that was removed to the indexes and the update log.
+   */
+  void Record::erased(const string& key) {
+    Record::cache.invalidate(key);
+    Record::directories.erased(key);
+    Record::indexes.remove(key);
+    Record::log.remove(key);
+  }
+
+  /**
+   * Passes a clear of the database to the indexes and the update log.
+   */
+  void Record::cleared() {
+    Record::cache.clear();
+    Record::directories.clear();
+    Record::indexes.clear();
+    Record::log.clear();
+  }
+
+  /**
+   * Moves a cursor from a key of a directory member to the first key behind the subtree of the member.
+   * A member directory is skipped with a single jump.
+   * @param cur the cursor, positioned at key.
+   * @param key a key of the member.
+   * @param prefixSize size of the key prefix of the directory.
+   * @return false if there is no key behind the member.
+   */
+  bool Record::skipMember(Engine::Cursor& cur, const string& key, size_t prefixSize) {
+    const size_t end = key.find('/', prefixSize);
+    if(end == string::npos)
+      return cur.step();
+
+    // '0' is the character following '/', so this lands behind the member subtree
+    return cur.jump(key.substr(0, end) + '0');
+  }
+
   bool Record::setValue(const string& v) {
     if(!isInitialized())
       throw record_exception() << path_info({"uninitialized record", this->pathObj});
 
-    return getCursorPtr()->set_value_str(v);
+    string k;
+    if(Record::log.isOpen() || !Record::indexes.empty() || Record::cache.enabled())
+      getCursorPtr()->get_key(&k);
+
+    if(!getCursorPtr()->set_value_str(v))
+      return false;
+
+    Record::written(k, v);
+    return true;
   }
 
   bool Record::get(string& k, string& v) {
@@ -132,7 +265,7 @@ namespace janosh {
 
     bool r = getCursorPtr()->step();
     if(r) {
-      this->clear();
+      this->valueObj.reset();
       readPath();
     }
     return r;
@@ -144,7 +277,7 @@ namespace janosh {
 
     bool r = getCursorPtr()->step_back();
     if(r) {
-      this->clear();
+      this->valueObj.reset();
       readPath();
     }
     return r;
@@ -214,6 +347,42 @@ namespace janosh {
     return this->getType() == Value::Range;
   }
 
+  const bool Record::isSlice() const {
+    return this->path().isSlice();
+  }
+
+  /**
+   * Resolves a slice to the key range of the array members it selects, clamped to the size of the array.
+   * @param begin receives the first key of the first selected member, its value or its directory header.
+   * @param end receives the key the range ends before.
+   * @return number of selected members.
+   */
+  size_t Record::range(string& begin, string& end) {
+    if(!isSlice())
+      throw record_exception() << path_info({"not a slice", this->pathObj});
+
+    fetch();
+    if(!exists() || value().getType() != Value::Array)
+      throw record_exception() << path_info({"slices apply to arrays only", this->pathObj});
+
+    const Component c = path().name();
+    const size_t size = getSize();
+    const size_t first = std::min(c.sliceBegin(), size);
+    const size_t last = std::max(first, std::min(c.sliceEnd(), size));
+    const Path base = path().basePath();
+
+    end = base.withChild(last).key();
+    if(first == last) {
+      begin = end;
+      return 0;
+    }
+
+    if(!getCursorPtr()->jump(base.withChild(first).key()) || !getCursorPtr()->get_key(&begin))
+      throw record_exception() << path_info({"array member missing", this->pathObj});
+
+    return last - first;
+  }
+
   const bool Record::isValue() const {
     return !this->path().isDirectory() || this->getType() == Value::String;
   }
@@ -261,7 +430,7 @@ namespace janosh {
 
     if(path().isDirectory()) {
       valueObj = Value(v, true);
-    } else if(path().isWildcard()) {
+    } else if(path().isWildcard() || path().isSlice()) {
       valueObj = Value(v, Value::Range);
     } else {
       valueObj = Value(v, false);
@@ -276,7 +445,7 @@ namespace janosh {
 
     string k;
     bool s = getCursorPtr()->get_key(&k);
-    pathObj = k;
+    pathObj.advance(k);
     return s;
   }
 
@@ -294,6 +463,19 @@ namespace janosh {
     return *this;
   }
 
+  /**
+   * Points the record to another path and fetches it, reusing the cursor.
+   */
+  Record& Record::fetch(const Path& path) {
+    if(!isInitialized())
+      throw record_exception() << path_info({"uninitialized record", this->pathObj});
+
+    this->clear();
+    this->pathObj = path;
+    init(path);
+    return *this;
+  }
+
   bool Record::operator==(const Record& other) const {
     return this->path() == other.path();
   }
@@ -308,14 +490,24 @@ namespace janosh {
   }
 
   std::ostream& operator<< (std::ostream& os, const janosh::Value& v) {
-      os << v.str();
+      if(v.getType() == Value::Array)
+        os << 'A' << v.getSize();
+      else if(v.getType() == Value::Object)
+        os << 'O' << v.getSize();
+      else
+        os << v.str();
       return os;
   }
 
   std::ostream& operator<< (std::ostream& os, const janosh::Record& r) {
       os << "path=" << r.path().pretty()
           << " exists=" << (r.exists() ? "true" : "false")
-          << " value=" <<  (r.isInitialized() && r.value().isInitialized() ? r.value().str() : "N/A");
+          << " value=";
+
+      if(r.isInitialized() && r.value().isInitialized())
+        os << r.value();
+      else
+        os << "N/A";
 
       return os;
   }
@@ -9,26 +9,65 @@
 #include <boost/foreach.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/smart_ptr.hpp>
-#include <kcpolydb.h>
 #include <bitset>
 
 #include "path.hpp"
 #include "value.hpp"
 #include "logger.hpp"
 #include "exception.hpp"
+#include "engine.hpp"
+#include "updatelog.hpp"
+#include "index.hpp"
+#include "cache.hpp"
 
 namespace janosh {
-  namespace kc = kyotocabinet;
-  typedef kc::DB::Cursor Cursor;
+  typedef Engine::Cursor Cursor;
+
+  /**
+   * Cursor that positions itself on first use. A record served from the RecordCache hands its key
+   * to the cursor instead of seeking, so the seek is only paid if the cursor is actually used.
+   */
+  class DeferredCursor : public Engine::Cursor {
+    boost::scoped_ptr<Engine::Cursor> cur;
+    string target;
+    bool pending;
+
+    Engine::Cursor* use();
+  public:
+    DeferredCursor(Engine::Cursor* cur);
+
+    void defer(const string& key);
+
+    virtual bool jump();
+    virtual bool jump(const string& key);
+    virtual bool jump_back(const string& key);
+    virtual bool step();
+    virtual bool step_back();
 
-  class Record : private boost::shared_ptr<kc::DB::Cursor> {
+    virtual bool get_key(string* key, bool step = false);
+    virtual bool get_value(string* value, bool step = false);
+    virtual bool get(string* key, string* value, bool step = false);
+    virtual bool set_value_str(const string& value);
+    virtual bool remove();
+  };
+
+  class Record : private boost::shared_ptr<Engine::Cursor> {
     Path pathObj;
     Value valueObj;
     bool doesExist;
 
     void init(const Path path);
   public:
-    static kc::TreeDB db;
+    static Engine* db;
+    static UpdateLog log;
+    static IndexSet indexes;
+    static RecordCache cache;
+    static DirectoryCache directories;
+
+    static void written(const string& key, const string& value);
+    static void erased(const string& key);
+    static void cleared();
+    static bool skipMember(Engine::Cursor& cur, const string& key, size_t prefixSize);
 
     //exact copy referring to the same Cursor*
     Record(const Record& other);
@@ -37,7 +76,7 @@ namespace janosh {
     Record();
 
 
-    kc::DB::Cursor* getCursorPtr();
+    Engine::Cursor* getCursorPtr();
     const Value::Type getType()  const;
     const size_t getSize() const;
     const size_t getIndex() const;
@@ -54,6 +93,7 @@ namespace janosh {
     void next();
     void previous();
     void remove();
+    size_t range(string& begin, string& end);
 
     const Path& path() const;
     const Value& value() const;
@@ -64,6 +104,7 @@ namespace janosh {
     const bool isArray() const;
     const bool isDirectory() const;
     const bool isRange() const;
+    const bool isSlice() const;
     const bool isValue() const;
     const bool isObject() const;
     const bool isInitialized() const;
@@ -72,6 +113,7 @@ namespace janosh {
     const bool empty() const;
 
     Record& fetch();
+    Record& fetch(const Path& path);
     bool readValue();
     bool readPath();
     bool read();
@@ -0,0 +1,308 @@
+#include "snapshot.hpp"
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace janosh {
+  const char SnapshotEngine::magic[8] = { 'J', 'S', 'N', 'A', 'P', '0', '0', '1' };
+  const size_t SnapshotEngine::headerSize = sizeof(magic) + sizeof(uint64_t) + sizeof(uint64_t);
+
+  SnapshotEngine::Cursor::Cursor(const SnapshotEngine& engine) :
+    engine(engine),
+    index(0),
+    valid(false) {
+  }
+
+  bool SnapshotEngine::Cursor::seek(uint64_t i) {
+    valid = i < engine.records;
+    if(valid)
+      index = i;
+    return valid;
+  }
+
+  bool SnapshotEngine::Cursor::jump() {
+    return seek(0);
+  }
+
+  bool SnapshotEngine::Cursor::jump(const string& key) {
+    return seek(engine.lowerBound(key));
+  }
+
+  bool SnapshotEngine::Cursor::jump_back(const string& key) {
+    uint64_t i = engine.upperBound(key);
+    if(i == 0) {
+      valid = false;
+      return false;
+    }
+    return seek(i - 1);
+  }
+
+  bool SnapshotEngine::Cursor::step() {
+    return valid && seek(index + 1);
+  }
+
+  bool SnapshotEngine::Cursor::step_back() {
+    if(!valid || index == 0) {
+      valid = false;
+      return false;
+    }
+    return seek(index - 1);
+  }
+
+  bool SnapshotEngine::Cursor::get_key(string* key, bool st) {
+    return get(key, NULL, st);
+  }
+
+  bool SnapshotEngine::Cursor::get_value(string* value, bool st) {
+    return get(NULL, value, st);
+  }
+
+  bool SnapshotEngine::Cursor::get(string* key, string* value, bool st) {
+    if(!valid)
+      return false;
+
+    const char* k;
+    const char* v;
+    uint32_t ks, vs;
+    engine.read(index, k, ks, v, vs);
+    if(key)
+      key->assign(k, ks);
+    if(value)
+      value->assign(v, vs);
+    if(st)
+      step();
+    return true;
+  }
+
+  bool SnapshotEngine::Cursor::set_value_str(const string& value) {
+    return false;
+  }
+
+  bool SnapshotEngine::Cursor::remove() {
+    return false;
+  }
+
+  SnapshotEngine::SnapshotEngine() :
+    base(NULL),
+    records(0),
+    indexOffset(0),
+    index(NULL) {
+  }
+
+  bool SnapshotEngine::open(const string& path, uint32_t mode) {
+    using namespace boost::interprocess;
+    if(mode & OWRITER)
+      return readOnly();
+
+    try {
+      file_mapping f(path.c_str(), read_only);
+      mapped_region r(f, read_only);
+      file.swap(f);
+      region.swap(r);
+    } catch(interprocess_exception& ex) {
+      lastError = ex.what();
+      return false;
+    }
+
+    const size_t size = region.get_size();
+    base = static_cast<const char*>(region.get_address());
+
+    if(size < headerSize || memcmp(base, magic, sizeof(magic)) != 0) {
+      lastError = "not a snapshot file";
+      close();
+      return false;
+    }
+
+    memcpy(&records, base + sizeof(magic), sizeof(records));
+    memcpy(&indexOffset, base + sizeof(magic) + sizeof(records), sizeof(indexOffset));
+
+    if(indexOffset % sizeof(uint64_t) != 0 || indexOffset < headerSize || indexOffset > size
+        || records != (size - indexOffset) / sizeof(uint64_t) || (size - indexOffset) % sizeof(uint64_t) != 0) {
+      lastError = "broken snapshot index";
+      close();
+      return false;
+    }
+
+    index = reinterpret_cast<const uint64_t*>(base + indexOffset);
+    return true;
+  }
+
+  bool SnapshotEngine::close() {
+    boost::interprocess::mapped_region r;
+    boost::interprocess::file_mapping f;
+    region.swap(r);
+    file.swap(f);
+    base = NULL;
+    index = NULL;
+    records = 0;
+    indexOffset = 0;
+    return true;
+  }
+
+  string SnapshotEngine::error() {
+    return lastError;
+  }
+
+  Engine::Cursor* SnapshotEngine::cursor() {
+    return new SnapshotEngine::Cursor(*this);
+  }
+
+  bool SnapshotEngine::get(const string& key, string* value) {
+    uint64_t i = lowerBound(key);
+    if(i == records || compare(i, key) != 0) {
+      lastError = "no record";
+      return false;
+    }
+
+    const char* k;
+    const char* v;
+    uint32_t ks, vs;
+    read(i, k, ks, v, vs);
+    value->assign(v, vs);
+    return true;
+  }
+
+  bool SnapshotEngine::set(const string& key, const string& value) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::add(const string& key, const string& value) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::replace(const string& key, const string& value) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::remove(const string& key) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::clear() {
+    return readOnly();
+  }
+
+  int64_t SnapshotEngine::count() {
+    return records;
+  }
+
+  bool SnapshotEngine::begin_transaction() {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::end_transaction(bool commit) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::defrag(int64_t step) {
+    return readOnly();
+  }
+
+  bool SnapshotEngine::readOnly() {
+    lastError = "snapshots are read only";
+    return false;
+  }
+
+  void SnapshotEngine::read(uint64_t i, const char*& key, uint32_t& ksize, const char*& value, uint32_t& vsize) const {
+    const uint64_t offset = index[i];
+    if(offset < headerSize || offset > indexOffset || indexOffset - offset < sizeof(ksize) + sizeof(vsize))
+      throw engine_exception() << string_info({"broken snapshot index", "record offset out of bounds"});
+
+    const char* rec = base + offset;
+    memcpy(&ksize, rec, sizeof(ksize));
+    memcpy(&vsize, rec + sizeof(ksize), sizeof(vsize));
+    if(static_cast<uint64_t>(ksize) + vsize > indexOffset - offset - sizeof(ksize) - sizeof(vsize))
+      throw engine_exception() << string_info({"broken snapshot record", "record overlaps the index"});
+
+    key = rec + sizeof(ksize) + sizeof(vsize);
+    value = key + ksize;
+  }
+
+  int SnapshotEngine::compare(uint64_t i, const string& key) const {
+    const char* k;
+    const char* v;
+    uint32_t ks, vs;
+    read(i, k, ks, v, vs);
+
+    int r = memcmp(k, key.data(), std::min<size_t>(ks, key.size()));
+    if(r != 0)
+      return r;
+    return ks < key.size() ? -1 : (ks > key.size() ? 1 : 0);
+  }
+
+  uint64_t SnapshotEngine::lowerBound(const string& key) const {
+    uint64_t lo = 0, hi = records;
+    while(lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if(compare(mid, key) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  uint64_t SnapshotEngine::upperBound(const string& key) const {
+    uint64_t lo = 0, hi = records;
+    while(lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if(compare(mid, key) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  /**
+   * Writes all records of an engine as a snapshot file.
+   * The file is written under a temporary name and renamed when complete.
+   * @return number of records written.
+   */
+  size_t SnapshotEngine::write(Engine& source, const string& path) {
+    const string tmp = path + ".tmp";
+    std::ofstream os(tmp.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    std::vector<uint64_t> offsets;
+    uint64_t records = 0;
+    uint64_t indexOffset = 0;
+
+    os.write(magic, sizeof(magic));
+    os.write(reinterpret_cast<const char*>(&records), sizeof(records));
+    os.write(reinterpret_cast<const char*>(&indexOffset), sizeof(indexOffset));
+    uint64_t offset = sizeof(magic) + sizeof(records) + sizeof(indexOffset);
+
+    Engine::Cursor* cur = source.cursor();
+    string key, value;
+    cur->jump();
+    while(cur->get(&key, &value, true)) {
+      const uint32_t ksize = key.size();
+      const uint32_t vsize = value.size();
+      offsets.push_back(offset);
+      os.write(reinterpret_cast<const char*>(&ksize), sizeof(ksize));
+      os.write(reinterpret_cast<const char*>(&vsize), sizeof(vsize));
+      os.write(key.data(), ksize);
+      os.write(value.data(), vsize);
+      offset += sizeof(ksize) + sizeof(vsize) + ksize + vsize;
+    }
+    delete cur;
+
+    const char pad[sizeof(uint64_t)] = { 0 };
+    const size_t padding = (sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t);
+    os.write(pad, padding);
+    indexOffset = offset + padding;
+    records = offsets.size();
+    os.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+    os.seekp(sizeof(magic));
+    os.write(reinterpret_cast<const char*>(&records), sizeof(records));
+    os.write(reinterpret_cast<const char*>(&indexOffset), sizeof(indexOffset));
+    os.close();
+
+    if(!os.good())
+      throw engine_exception() << string_info({"failed to write snapshot", tmp});
+
+    boost::filesystem::rename(tmp, path);
+    return records;
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef _JANOSH_SNAPSHOT_HPP
+#define _JANOSH_SNAPSHOT_HPP
+
+#include <string>
+#include <stdint.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "engine.hpp"
+
+namespace janosh {
+  using std::string;
+
+  /**
+   * Read only engine serving an immutable, sorted, memory mapped snapshot file.
+   * Opening maps the file. Lookups binary search the index block in place, there is no locking.
+   * Every record read is checked to lie between the header and the index, a broken file throws an engine_exception.
+   *
+   * File layout (native byte order):
+   *   header:  char[8] magic | uint64 record count | uint64 index offset
+   *   records: uint32 key size | uint32 value size | key | value   (in key order)
+   *   index:   uint64 record offset * record count                 (8 byte aligned)
+   */
+  class SnapshotEngine : public Engine {
+  public:
+    class Cursor : public Engine::Cursor {
+      const SnapshotEngine& engine;
+      uint64_t index;
+      bool valid;
+
+      bool seek(uint64_t i);
+    public:
+      Cursor(const SnapshotEngine& engine);
+
+      virtual bool jump();
+      virtual bool jump(const string& key);
+      virtual bool jump_back(const string& key);
+      virtual bool step();
+      virtual bool step_back();
+
+      virtual bool get_key(string* key, bool step = false);
+      virtual bool get_value(string* value, bool step = false);
+      virtual bool get(string* key, string* value, bool step = false);
+      virtual bool set_value_str(const string& value);
+      virtual bool remove();
+    };
+
+    SnapshotEngine();
+
+    virtual bool open(const string& path, uint32_t mode);
+    virtual bool close();
+    virtual string error();
+    virtual Engine::Cursor* cursor();
+
+    virtual bool get(const string& key, string* value);
+    virtual bool set(const string& key, const string& value);
+    virtual bool add(const string& key, const string& value);
+    virtual bool replace(const string& key, const string& value);
+    virtual bool remove(const string& key);
+    virtual bool clear();
+    virtual int64_t count();
+
+    virtual bool begin_transaction();
+    virtual bool end_transaction(bool commit = true);
+    virtual bool defrag(int64_t step);
+
+    static size_t write(Engine& source, const string& path);
+  private:
+    static const char magic[8];
+    static const size_t headerSize;
+
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const char* base;
+    uint64_t records;
+    uint64_t indexOffset;
+    const uint64_t* index;
+    string lastError;
+
+    void read(uint64_t i, const char*& key, uint32_t& ksize, const char*& value, uint32_t& vsize) const;
+    int compare(uint64_t i, const string& key) const;
+    uint64_t lowerBound(const string& key) const;
+    uint64_t upperBound(const string& key) const;
+    bool readOnly();
+  };
+}
+
+#endif
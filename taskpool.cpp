@@ -0,0 +1,56 @@
+#include "taskpool.hpp"
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <boost/thread.hpp>
+
+namespace janosh {
+  /**
+   * @param threads number of worker threads. 0 uses one thread per core.
+   */
+  TaskPool::TaskPool(size_t threads) :
+    threads(threads) {
+    if(this->threads == 0)
+      this->threads = std::max<size_t>(1, boost::thread::hardware_concurrency());
+  }
+
+  size_t TaskPool::size() const {
+    return threads;
+  }
+
+  /**
+   * Runs the tasks 0 to tasks - 1 and returns when all of them are done.
+   * @param tasks number of tasks.
+   * @param task the function to call with the task number.
+   */
+  void TaskPool::run(size_t tasks, boost::function<void(size_t)> task) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    boost::mutex errorMutex;
+
+    auto worker = [&]() {
+      size_t t;
+      while((t = next++) < tasks) {
+        try {
+          task(t);
+        } catch(...) {
+          boost::lock_guard<boost::mutex> lock(errorMutex);
+          if(!error)
+            error = std::current_exception();
+          next = tasks;
+        }
+      }
+    };
+
+    boost::thread_group group;
+    const size_t workers = std::min(threads, tasks);
+    for(size_t i = 1; i < workers; ++i)
+      group.create_thread(worker);
+
+    worker();
+    group.join_all();
+
+    if(error)
+      std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef _JANOSH_TASKPOOL_HPP
+#define _JANOSH_TASKPOOL_HPP
+
+#include <stddef.h>
+#include <boost/function.hpp>
+
+namespace janosh {
+  /**
+   * Runs a number of independent tasks on a group of worker threads.
+   * Every worker claims the next task nobody started yet, so a few long running tasks don't hold up the rest.
+   * The calling thread works as well. The first exception thrown by a task stops the pool and is rethrown by run().
+   */
+  class TaskPool {
+  public:
+    TaskPool(size_t threads);
+
+    void run(size_t tasks, boost::function<void(size_t)> task);
+    size_t size() const;
+  private:
+    size_t threads;
+  };
+}
+
+#endif
@@ -16,6 +16,14 @@ function finalize() {
   janosh hash
 }
 
+# prints a home directory whose configuration extends the current one by the given settings
+function configure() {
+  home=`mktemp -d`
+  cp -r $HOME/.janosh $home/
+  sed "0,/{/s|{|{ $1,|" $HOME/.janosh/janosh.json > $home/.janosh/janosh.json
+  echo $home
+}
+
 function test_truncate() {
   true
 }
@@ -117,6 +125,30 @@ function test_copy() {
   [ `janosh -r get /object/array/#0` -eq 0 ]  || return 1
 }
 
+function test_move() {
+  janosh mkobj /object/.                  || return 1
+  janosh mkarr /array/.                   || return 1
+  janosh append /array/. 0 1 2 3          || return 1
+  janosh move /array/#1 /object/one       || return 1
+  [ `janosh size /array/.` -eq 3 ]        || return 1
+  [ `janosh -r get /array/#1` -eq 2 ]     || return 1
+  [ `janosh -r get /object/one` -eq 1 ]   || return 1
+  janosh move /object/one /array/#3       || return 1
+  [ `janosh size /array/.` -eq 4 ]        || return 1
+  [ `janosh size /object/.` -eq 0 ]       || return 1
+  [ `janosh -r get /array/#3` -eq 1 ]     || return 1
+  janosh mkarr /array/#4/.                || return 1
+  janosh append /array/#4/. 5 6           || return 1
+  janosh move /array/#4/. /object/sub/.   || return 1
+  [ `janosh size /array/.` -eq 4 ]        || return 1
+  [ `janosh size /object/sub/.` -eq 2 ]   || return 1
+  janosh move /object/sub/. /array/#0/.   || return 1
+  [ `janosh size /array/.` -eq 4 ]        || return 1
+  [ `janosh -r get /array/#0/#1` -eq 6 ]  || return 1
+  janosh move /array/#0/. /array/#0/#0/.  && return 1
+  janosh move /object/missing /array/#0   && return 1 || return 0
+}
+
 function test_shift() {
   janosh mkarr /array/.                 || return 1
   janosh append /array/. 0 1 2 3        || return 1
@@ -138,6 +170,241 @@ function test_shift() {
   [ `janosh -r get /array/#8/#0` -eq 7  ] || return 1
 }
 
+function test_backup() {
+  janosh mkarr /array/.                         || return 1
+  janosh append /array/. 0 1 2 3                || return 1
+  janosh mkobj /object/.                        || return 1
+  janosh set /object/name blu                   || return 1
+  h=`janosh hash`
+  janosh --binary export /tmp/janosh_test.bak   || return 1
+  janosh remove /array/.                        || return 1
+  janosh --binary import /tmp/janosh_test.bak   || return 1
+  [ "`janosh hash`" == "$h" ]                   || return 1
+  [ `janosh -r get /array/#3` -eq 3 ]           || return 1
+  # a broken block size is rejected before the block is read
+  printf '\xff\xff\xff\xff' | dd of=/tmp/janosh_test.bak bs=1 seek=12 conv=notrunc 2>/dev/null
+  janosh --binary import /tmp/janosh_test.bak   && return 1
+  [ "`janosh hash`" == "$h" ]                   || return 1
+  rm -f /tmp/janosh_test.bak
+}
+
+function test_filter() {
+  janosh mkarr /array/.                                     || return 1
+  janosh mkobj /array/#0/.                                  || return 1
+  janosh set /array/#0/votes 5                              || return 1
+  janosh mkobj /array/#1/.                                  || return 1
+  janosh set /array/#1/votes 1                              || return 1
+  [ `janosh -r get /array/. where .votes '>' 3` -eq 5 ]     || return 1
+  [ -z "`janosh -r get /array/. where .votes '>' 5`" ]      || return 1
+  janosh set /array/#1/pinned true                          || return 1
+  [ "`janosh -r get /array/. where .pinned == true`" == "true
+1" ]                                                        || return 1
+  [ `janosh -r get /array/. where .pinned != true` -eq 5 ]  || return 1
+  janosh get /array/. where .votes '>'                      && return 1 || return 0
+}
+
+function test_index() {
+  janosh mkarr /array/.                                  || return 1
+  janosh mkobj /array/#0/.                               || return 1
+  janosh set /array/#0/id a                              || return 1
+  janosh mkobj /array/#1/.                               || return 1
+  janosh set /array/#1/id b                              || return 1
+  janosh index create '/array/*/id'                      || return 1
+  [ "`janosh lookup '/array/*/id' b`" == "/array/#1" ]   || return 1
+  janosh remove /array/#0/.                              || return 1
+  [ "`janosh lookup '/array/*/id' b`" == "/array/#0" ]   || return 1
+  janosh replace /array/#0/id c                          || return 1
+  janosh lookup '/array/*/id' b                          && return 1
+  [ "`janosh lookup '/array/*/id' c`" == "/array/#0" ]   || return 1
+}
+
+function test_page() {
+  janosh mkarr /array/.                                       || return 1
+  janosh append /array/. 0 1 2 3 4 5                          || return 1
+  [ "`janosh -r --offset 2 --limit 2 get /array/.`" == "2
+3" ]                                                          || return 1
+  [ "`janosh -r --tail 1 get /array/.`" == "5" ]              || return 1
+  [ -z "`janosh -r --offset 6 get /array/.`" ]                || return 1
+  janosh -r --limit -1 get /array/.                           && return 1
+  janosh -r --offset x get /array/.                           && return 1
+  [ "`janosh size /array/.`" == "6" ]                         || return 1
+}
+
+function test_slice() {
+  janosh mkarr /array/.                                       || return 1
+  janosh append /array/. 0 1 2 3 4 5                          || return 1
+  [ "`janosh -r get /array/#1:#3`" == "1
+2" ]                                                          || return 1
+  janosh copy /array/#4: /copy/.                              || return 1
+  [ "`janosh -r get /copy/.`" == "4
+5" ]                                                          || return 1
+  janosh remove /array/#0:#2                                  || return 1
+  [ "`janosh size /array/.`" == "4" ]                         || return 1
+  [ "`janosh -r get /array/#0`" == "2" ]                      || return 1
+}
+
+function test_agg() {
+  janosh mkarr /stats/.                                       || return 1
+  for i in 0 1 2; do
+    janosh mkobj /stats/#$i/.                                 || return 1
+  done
+  janosh set /stats/#0/bytes 10                               || return 1
+  janosh set /stats/#1/bytes 20                               || return 1
+  janosh set /stats/#2/bytes 20                               || return 1
+  [ "`janosh agg sum /stats/*/bytes`" == "50" ]               || return 1
+  [ "`janosh agg max /stats/*/bytes`" == "20" ]               || return 1
+  [ "`janosh agg distinct /stats/*/bytes`" == "2" ]           || return 1
+  janosh -p abc agg count /stats/*/bytes                      && return 1
+  [ "`janosh -p 2 agg count /stats/*/bytes`" == "3" ]         || return 1
+}
+
+function test_batch() {
+  janosh mkarr /array/.                                       || return 1
+  janosh add /array/#0 a /array/#1 b /array/#2 c              || return 1
+  [ "`janosh size /array/.`" == "3" ]                         || return 1
+  janosh set /array/#0 x /array/#5 y                          && return 1
+  [ "`janosh -r get /array/#0`" == "a" ]                      || return 1
+  [ "`janosh size /array/.`" == "3" ]                         || return 1
+}
+
+function test_sync() {
+  janosh set /value 1                                         || return 1
+  janosh sync                                                 || return 1
+  [ "`janosh -r get /value`" == "1" ]                         || return 1
+}
+
+function test_types() {
+  doc='{"object":{"frac":0.25,"int":1,"neg":-7,"no":false,"none":null,"real":1.0,"yes":true}}'
+  echo "$doc" | janosh load
+  [ "{`janosh -j get /object/. | tr -d ' \n'`}" == "$doc" ]   || return 1
+  # members of the same name are stored as one, serially and in parallel
+  for p in 1 4; do
+    janosh truncate                                           || return 1
+    echo '{"a":1,"b":{"x":1,"x":2},"a":2,"c":3}' | janosh -p $p load
+    [ "`janosh size /.`" == "3" ]                             || return 1
+    [ "`janosh size /b/.`" == "1" ]                           || return 1
+    [ "`janosh -r get /a`" == "2" ]                           || return 1
+  done
+}
+
+function test_follow() {
+  rm -f janosh.ulog /tmp/janosh_follow.db /tmp/janosh_follow.db.pos
+  primary=`configure '"updateLog": "janosh.ulog"'`
+  follower=`configure '"engine": "kyoto", "database": "/tmp/janosh_follow.db"'`
+  HOME=$primary janosh mkarr /array/.                                 || return 1
+  HOME=$primary janosh add /array/#0 a /array/#1 b                    || return 1
+  HOME=$primary janosh follow /tmp/janosh_follow.db                   || return 1
+  [ "`cat /tmp/janosh_follow.db.pos`" == "`stat -c %s janosh.ulog`" ] || return 1
+  [ "`HOME=$follower janosh hash`" == "`janosh hash`" ]               || return 1
+  HOME=$primary janosh add /array/#2 c /array/#3 d                    || return 1
+  # drop the commit marker of the last transaction, which must not be applied without it
+  truncate -s -17 janosh.ulog                                         || return 1
+  HOME=$primary janosh follow /tmp/janosh_follow.db                   || return 1
+  [ "`cat /tmp/janosh_follow.db.pos`" -lt "`stat -c %s janosh.ulog`" ] || return 1
+  [ "`HOME=$follower janosh size /array/.`" == "2" ]                  || return 1
+  # the group without a commit marker is dropped once the next one begins
+  HOME=$primary janosh set /array/#0 z                                || return 1
+  HOME=$primary janosh follow /tmp/janosh_follow.db                   || return 1
+  [ "`cat /tmp/janosh_follow.db.pos`" == "`stat -c %s janosh.ulog`" ] || return 1
+  [ "`HOME=$follower janosh size /array/.`" == "2" ]                  || return 1
+  [ "`HOME=$follower janosh -r get /array/#0`" == "z" ]               || return 1
+  rm -rf $primary $follower janosh.ulog /tmp/janosh_follow.db /tmp/janosh_follow.db.pos
+}
+
+function test_logerror() {
+  full=`configure '"updateLog": "/dev/full"'`
+  janosh mkarr /array/.                                               || return 1
+  HOME=$full janosh add /array/#0 a /array/#1 b                       && return 1
+  [ "`janosh size /array/.`" == "0" ]                                 || return 1
+  rm -rf $full
+}
+
+function test_cache() {
+  # a large budget keeps every record read, a small one evicts while the commands run
+  for budget in 1000000 400; do
+    cached=`configure '"cache": { "budget": '$budget' }'`
+    for t in set remove copy move batch; do
+      HOME=$cached janosh truncate                                    || return 1
+      HOME=$cached test_$t                                            || return 1
+    done
+    rm -rf $cached
+  done
+}
+
+function test_snapshot() {
+  snap=/tmp/janosh_test.snap
+  janosh mkarr /array/.                                               || return 1
+  janosh append /array/. 0 1 2                                        || return 1
+  janosh snapshot $snap                                               || return 1
+  [ "`janosh -s $snap -r get /array/#2`" == "2" ]                     || return 1
+  [ "`janosh -s $snap hash`" == "`janosh hash`" ]                     || return 1
+  janosh -s $snap set /array/#0 x                                     && return 1
+  [ "`janosh -r get /array/#0`" == "0" ]                              || return 1
+  # point the last index entry behind the end of the records
+  printf '\xff\xff\xff\x00\x00\x00\x00\x00' | dd of=$snap bs=1 seek=$((`stat -c %s $snap` - 8)) conv=notrunc 2>/dev/null
+  janosh -s $snap get /array/.                                        && return 1
+  # a missing or foreign file fails right away instead of being waited for
+  rm -f $snap
+  timeout 10 janosh -s $snap get /.; [ $? -eq 1 ]                     || return 1
+  echo "no snapshot" > $snap
+  timeout 10 janosh -s $snap get /.; [ $? -eq 1 ]                     || return 1
+  rm -f $snap
+}
+
+function test_msgpack() {
+  echo '{"m":{"a":[1,"x"],"o":{"n":-1},"r":0.5,"s":"hi"}}' | janosh load
+  # fixmap 4, fixarray 2, fixstr, positive and negative fixint, float 64
+  bytes="84a1619201a178a16f81a16effa172cb3fe0000000000000a173a26869"
+  [ "`janosh -f msgpack get /m/. | od -An -tx1 | tr -d ' \n'`" == "$bytes" ]       || return 1
+  [ "`janosh -p 4 -f msgpack get /m/. | od -An -tx1 | tr -d ' \n'`" == "$bytes" ]  || return 1
+}
+
+function test_lines() {
+  janosh mkobj /object/.                                              || return 1
+  janosh set /object/tab "`printf 'a\tb'`" /object/nl "`printf 'c\nd'`" /object/bs 'e\f' || return 1
+  # the values are escaped, the tab between path and value is not
+  expected=$(printf '%s\t%s\n' /object/bs 'e\\f' /object/nl 'c\nd' /object/tab 'a\tb')
+  [ "`janosh -f lines get /object/.`" == "$expected" ]                || return 1
+  janosh mkarr /array/.                                               || return 1
+  for i in 0 1 2 3 4 5 6 7 8 9; do
+    janosh mkobj /array/#$i/.                                         || return 1
+    janosh set /array/#$i/id $i /array/#$i/name "`printf 'n\t%d' $i`" || return 1
+  done
+  [ "`janosh -p 1 -f lines get /array/.`" == "`janosh -p 4 -f lines get /array/.`" ] || return 1
+  [ "`janosh -p 4 -f lines get /array/. | wc -l`" -eq 20 ]           || return 1
+}
+
+# prints a number as 4 byte little endian binary
+function u32() {
+  printf "$(printf '\\x%02x\\x%02x\\x%02x\\x%02x' $(($1 & 255)) $(($1 >> 8 & 255)) $(($1 >> 16 & 255)) $(($1 >> 24 & 255)))"
+}
+
+function test_migrate() {
+  janosh mkobj /object/.                                              || return 1
+  janosh set /object/a x /object/b y                                  || return 1
+  h=`janosh hash`
+
+  # the same records as written by older versions: text headers and untagged leaves, as a binary backup
+  payload=/tmp/janosh_test.payload
+  rm -f $payload
+  for kv in "/!:O1" "/object/!:O2" "/object/a:x" "/object/b:y"; do
+    k=${kv%%:*}; v=${kv#*:}
+    (u32 ${#k}; u32 ${#v}; printf '%s%s' "$k" "$v") >> $payload
+  done
+  # gzip ends with the crc32 of its input
+  (printf 'JBAK0001'; u32 4; u32 `stat -c %s $payload`; gzip -c $payload | tail -c 8 | head -c 4
+   cat $payload; u32 0; u32 0; u32 0) > /tmp/janosh_test.bak
+  janosh --binary import /tmp/janosh_test.bak                         || return 1
+  rm -f $payload /tmp/janosh_test.bak
+
+  [ "`janosh -r get /object/b`" == "y" ]                              || return 1
+  [ "`janosh size /object/.`" == "2" ]                                || return 1
+  [ "`janosh hash`" != "$h" ]                                         || return 1
+  janosh migrate                                                      || return 1
+  [ "`janosh hash`" == "$h" ]                                         || return 1
+  [ "`janosh -r get /object/a`" == "x" ]                              || return 1
+}
+
 function run() {
   ( 
     prepare
@@ -174,7 +441,24 @@ if [ -z "$1" ]; then
   run remove
   run replace
   run copy
+  run move
   run shift
+  run backup
+  run filter
+  run index
+  run page
+  run slice
+  run agg
+  run batch
+  run sync
+  run types
+  run follow
+  run logerror
+  run cache
+  run snapshot
+  run msgpack
+  run lines
+  run migrate
 else
   run $1
 fi
@@ -0,0 +1,331 @@
+#include "updatelog.hpp"
+#include "logger.hpp"
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+
+namespace janosh {
+  UpdateLog::UpdateLog() :
+    listening(false),
+    flushed(false) {
+  }
+
+  UpdateLog::~UpdateLog() {
+    close();
+  }
+
+  void UpdateLog::open(const fs::path& file) {
+    out.open(file.string().c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    if(!out.good())
+      throw replication_exception() << string_info({"can't open update log", file.string()});
+
+    if(!listening) {
+      Transaction::prepare(boost::bind(&UpdateLog::flush, this));
+      Transaction::listen(boost::bind(&UpdateLog::finish, this, _1));
+      listening = true;
+    }
+  }
+
+  void UpdateLog::close() {
+    if(isOpen())
+      out.close();
+  }
+
+  bool UpdateLog::isOpen() const {
+    return out.is_open();
+  }
+
+  void UpdateLog::set(const string& key, const string& value) {
+    if(isOpen())
+      append(Set, key, value);
+  }
+
+  void UpdateLog::remove(const string& key) {
+    if(isOpen())
+      append(Remove, key, "");
+  }
+
+  void UpdateLog::clear() {
+    if(isOpen())
+      append(Clear, "", "");
+  }
+
+  /**
+   * Writes the whole content of a database as a clear followed by one set per record, committed as one.
+   * Used to seed a freshly created log so followers start from the current state.
+   */
+  void UpdateLog::image(Engine& db) {
+    if(!isOpen())
+      return;
+
+    string buf = entry(Begin, "", "") + entry(Clear, "", "");
+    Engine::Cursor* cur = db.cursor();
+    string key, value;
+    cur->jump();
+    while(cur->get(&key, &value, true)) {
+      buf.append(entry(Set, key, value));
+    }
+    delete cur;
+
+    buf.append(entry(Commit, "", ""));
+    write(buf);
+  }
+
+  uint64_t UpdateLog::now() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+  }
+
+  string UpdateLog::entry(const Op op, const string& key, const string& value) {
+    const uint64_t ts = now();
+    const char o = op;
+    const uint32_t ksize = key.size();
+    const uint32_t size = sizeof(ts) + sizeof(o) + sizeof(ksize) + key.size() + value.size();
+
+    string buf;
+    buf.reserve(sizeof(size) + size);
+    buf.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    buf.append(reinterpret_cast<const char*>(&ts), sizeof(ts));
+    buf.append(&o, sizeof(o));
+    buf.append(reinterpret_cast<const char*>(&ksize), sizeof(ksize));
+    buf.append(key);
+    buf.append(value);
+    return buf;
+  }
+
+  void UpdateLog::append(const Op op, const string& key, const string& value) {
+    if(Transaction::active())
+      pending.append(entry(op, key, value));
+    else
+      write(entry(Begin, "", "") + entry(op, key, value) + entry(Commit, "", ""));
+  }
+
+  void UpdateLog::write(const string& buf) {
+    // one write per entry or transaction so a concurrent reader never sees a torn header
+    out.write(buf.data(), buf.size());
+    out.flush();
+    if(!out.good())
+      throw replication_exception() << string_info({"failed to write update log", "write error"});
+  }
+
+  /**
+   * Writes the entries held back during a transaction before the engine commits it.
+   */
+  void UpdateLog::flush() {
+    string buf;
+    buf.swap(pending);
+    if(!buf.empty() && isOpen()) {
+      write(entry(Begin, "", "") + buf);
+      flushed = true;
+    }
+  }
+
+  /**
+   * Closes the group of a transaction written by flush with a commit or an abort marker,
+   * or drops the entries held back during a transaction that aborted before.
+   */
+  void UpdateLog::finish(bool commit) {
+    pending.clear();
+    if(!flushed || !isOpen())
+      return;
+
+    flushed = false;
+    if(commit) {
+      write(entry(Commit, "", ""));
+    } else {
+      try {
+        write(entry(Abort, "", ""));
+      } catch(replication_exception&) {
+        // followers drop the group anyway once the next one begins
+        LOG_ERR_MSG("can't write abort marker", "update log");
+      }
+    }
+  }
+
+  /**
+   * Reads the entry at the current position of the stream.
+   * @return false if there is no complete entry left.
+   */
+  bool UpdateLog::read(std::istream& in, Entry& e) {
+    uint32_t size;
+    uint32_t ksize;
+    char o;
+    e.position = in.tellg();
+
+    if(!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+      return false;
+
+    string buf(size, '\0');
+    if(!in.read(&buf[0], size))
+      return false;
+
+    const size_t header = sizeof(e.timestamp) + sizeof(o) + sizeof(ksize);
+    if(size < header)
+      throw replication_exception() << string_info({"corrupted update log entry", boost::lexical_cast<string>(e.position)});
+
+    memcpy(&e.timestamp, buf.data(), sizeof(e.timestamp));
+    memcpy(&o, buf.data() + sizeof(e.timestamp), sizeof(o));
+    memcpy(&ksize, buf.data() + sizeof(e.timestamp) + sizeof(o), sizeof(ksize));
+
+    if(header + ksize > size)
+      throw replication_exception() << string_info({"corrupted update log entry", boost::lexical_cast<string>(e.position)});
+
+    e.op = static_cast<Op>(o);
+    e.key = buf.substr(header, ksize);
+    e.value = buf.substr(header + ksize);
+    e.next = e.position + sizeof(size) + size;
+    return true;
+  }
+
+  Follower::Follower(const fs::path& logFile, const fs::path& dbFile) :
+    logFile(logFile),
+    dbFile(dbFile),
+    posFile(dbFile.string() + ".pos"),
+    position(0) {
+    uint32_t mode = Engine::OAUTOTRAN | Engine::OREADER | Engine::OWRITER | Engine::OCREATE;
+    if(!db.open(dbFile.string(), mode))
+      throw replication_exception() << string_info({"can't open follower database", dbFile.string()});
+
+    readPosition();
+  }
+
+  Follower::~Follower() {
+    db.close();
+  }
+
+  void Follower::readPosition() {
+    std::ifstream is(posFile.string().c_str());
+    if(is.good() && !(is >> position))
+      throw replication_exception() << string_info({"corrupted position file", posFile.string()});
+  }
+
+  void Follower::writePosition() {
+    const fs::path tmp(posFile.string() + ".tmp");
+    {
+      std::ofstream os(tmp.string().c_str(), std::ios::out | std::ios::trunc);
+      os << position << std::endl;
+      if(!os.good())
+        throw replication_exception() << string_info({"can't write position file", tmp.string()});
+    }
+    fs::rename(tmp, posFile);
+  }
+
+  void Follower::apply(const UpdateLog::Entry& e) {
+    switch(e.op) {
+      case UpdateLog::Set:
+        db.set(e.key, e.value);
+        break;
+      case UpdateLog::Remove:
+        db.remove(e.key);
+        break;
+      case UpdateLog::Clear:
+        db.clear();
+        break;
+      default:
+        throw replication_exception() << string_info({"unknown update log operation", boost::lexical_cast<string>(e.position)});
+    }
+  }
+
+  /**
+   * Applies all committed entries past the last applied position, in batches of one transaction each.
+   * A batch ends at the first commit marker once it holds maxBatch entries, so a large transaction
+   * of the primary makes a larger batch. Entries without a marker yet are left for the next poll.
+   * @param maxBatch number of entries after which a batch is committed.
+   * @return number of applied entries.
+   */
+  size_t Follower::poll(size_t maxBatch) {
+    std::ifstream in(logFile.string().c_str(), std::ios::in | std::ios::binary);
+    if(!in.good())
+      return 0;
+
+    in.seekg(0, std::ios::end);
+    const uint64_t end = in.tellg();
+    if(end < position)
+      throw replication_exception() << string_info({"update log is shorter than the follower position", logFile.string()});
+
+    in.seekg(position);
+    size_t cnt = 0;
+    size_t batch = 0;
+    uint64_t applied = position;
+    std::vector<UpdateLog::Entry> group;
+    UpdateLog::Entry e;
+
+    if(!db.begin_transaction())
+      throw replication_exception() << string_info({"can't begin transaction", db.error()});
+
+    try {
+      while(UpdateLog::read(in, e)) {
+        if(e.op == UpdateLog::Begin) {
+          // entries of a group that was never closed, left by a primary that crashed
+          group.clear();
+          continue;
+        } else if(e.op == UpdateLog::Abort) {
+          group.clear();
+          applied = e.next;
+          continue;
+        } else if(e.op != UpdateLog::Commit) {
+          group.push_back(e);
+          continue;
+        }
+
+        for(const UpdateLog::Entry& g : group)
+          apply(g);
+        batch += group.size();
+        group.clear();
+        applied = e.next;
+
+        if(batch >= maxBatch) {
+          if(!db.end_transaction(true))
+            throw replication_exception() << string_info({"can't commit transaction", db.error()});
+          position = applied;
+          writePosition();
+          cnt += batch;
+          batch = 0;
+
+          if(!db.begin_transaction())
+            throw replication_exception() << string_info({"can't begin transaction", db.error()});
+        }
+      }
+    } catch(...) {
+      db.end_transaction(false);
+      throw;
+    }
+
+    if(!db.end_transaction(true))
+      throw replication_exception() << string_info({"can't commit transaction", db.error()});
+
+    if(applied != position) {
+      position = applied;
+      writePosition();
+    }
+    cnt += batch;
+
+    LOG_DEBUG_MSG("applied entries", cnt);
+    return cnt;
+  }
+
+  /**
+   * Measures how far the follower is behind the primary.
+   * millis is the age of the oldest entry not yet applied, 0 if the follower is up to date.
+   */
+  Follower::Lag Follower::lag() {
+    Lag l = { position, position, 0, 0 };
+    std::ifstream in(logFile.string().c_str(), std::ios::in | std::ios::binary);
+    if(!in.good())
+      return l;
+
+    in.seekg(0, std::ios::end);
+    l.end = in.tellg();
+    l.bytes = l.end > position ? l.end - position : 0;
+
+    UpdateLog::Entry e;
+    in.seekg(position);
+    if(l.bytes > 0 && UpdateLog::read(in, e)) {
+      const uint64_t now = UpdateLog::now();
+      l.millis = now > e.timestamp ? now - e.timestamp : 0;
+    }
+    return l;
+  }
+}
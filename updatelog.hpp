@@ -0,0 +1,117 @@
+#ifndef _JANOSH_UPDATELOG_HPP
+#define _JANOSH_UPDATELOG_HPP
+
+#include <string>
+#include <fstream>
+#include <stdint.h>
+#include <boost/filesystem.hpp>
+
+#include "logger.hpp"
+#include "exception.hpp"
+#include "engine.hpp"
+
+namespace janosh {
+  namespace fs = boost::filesystem;
+  using std::string;
+
+  /**
+   * Append-only log of all key level mutations of the database.
+   * Every entry carries the final state of one key (set or removed) or a clear,
+   * so replaying the log from any earlier position converges to the same database.
+   * The byte offset of an entry in the log file is its sequence number.
+   *
+   * The entries of each transaction, and each entry written outside of one, form a group that starts with
+   * a begin marker and ends with a commit marker. Followers apply a group whole once its commit marker was read.
+   * Entries written within a transaction are held back and written just before the engine commits, so a failed
+   * write aborts the transaction instead of leaving the log behind the database. The commit marker is written
+   * after the engine committed, an abort marker if it failed. A group a crashed primary left without either is
+   * dropped by followers when the next group begins.
+   *
+   * The log is never truncated, it grows until it is removed while no follower is behind.
+   *
+   * Entry layout (native byte order):
+   *   uint32 size of the remainder | uint64 timestamp (ms) | char op | uint32 key size | key | value
+   */
+  class UpdateLog {
+  public:
+    enum Op {
+      Set = 'S',
+      Remove = 'R',
+      Clear = 'C',
+      Begin = 'B',
+      Commit = 'T',
+      Abort = 'A'
+    };
+
+    struct Entry {
+      uint64_t position;
+      uint64_t next;
+      uint64_t timestamp;
+      Op op;
+      string key;
+      string value;
+    };
+
+    UpdateLog();
+    ~UpdateLog();
+
+    void open(const fs::path& file);
+    void close();
+    bool isOpen() const;
+
+    void set(const string& key, const string& value);
+    void remove(const string& key);
+    void clear();
+    void image(Engine& db);
+
+    static uint64_t now();
+    static bool read(std::istream& in, Entry& e);
+  private:
+    std::ofstream out;
+    string pending;
+    bool listening;
+    bool flushed;
+
+    static string entry(const Op op, const string& key, const string& value);
+    void append(const Op op, const string& key, const string& value);
+    void write(const string& buf);
+    void flush();
+    void finish(bool commit);
+  };
+
+  /**
+   * Applies the update log of the primary database to a follower database file.
+   * Entries are applied once the commit marker of their transaction was read, and the last applied position,
+   * always just behind a marker, is kept in a sidecar file "<follower>.pos" written after each committed batch.
+   * A restarted follower resumes where it stopped and never holds half of a transaction of the primary.
+   */
+  class Follower {
+  public:
+    struct Lag {
+      uint64_t position;
+      uint64_t end;
+      uint64_t bytes;
+      uint64_t millis;
+    };
+
+    Follower(const fs::path& logFile, const fs::path& dbFile);
+    ~Follower();
+
+    size_t poll(size_t maxBatch = 10000);
+    Lag lag();
+  private:
+    fs::path logFile;
+    fs::path dbFile;
+    fs::path posFile;
+    KyotoEngine db;
+    uint64_t position;
+
+    void apply(const UpdateLog::Entry& e);
+    void readPosition();
+    void writePosition();
+  };
+
+  struct replication_exception : virtual janosh_exception { };
+}
+
+#endif
@@ -1,10 +1,32 @@
 #include "value.hpp"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <boost/lexical_cast.hpp>
 
 using namespace janosh;
 
+/**
+ * Formats a double with the least number of digits that still reads back to the same value.
+ * Integral values keep a fraction so they read back as reals and not as integers.
+ */
+static string formatReal(const double d) {
+  char buf[32];
+  for(int precision = 15; precision <= 17; ++precision) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, d);
+    if(strtod(buf, NULL) == d)
+      break;
+  }
+
+  string s(buf);
+  if(s.find_first_of(".e") == string::npos && s.find("inf") == string::npos && s.find("nan") == string::npos)
+    s += ".0";
+  return s;
+}
+
 Value::Value() :
-    strObj(), type(Null), initalized(false) {
+    strObj(), type(Null), size(0), integer(0), real(0), initalized(false), legacy(false) {
 }
 
 Value::Value(Type t) :
@@ -24,9 +46,13 @@ Value::Value(const string v, bool dir) :
 
 Value::Value(const Value& other) {
   this->strObj = other.strObj;
+  this->encodedObj = other.encodedObj;
   this->type = other.type;
   this->size = other.size;
+  this->integer = other.integer;
+  this->real = other.real;
   this->initalized = other.initalized;
+  this->legacy = other.legacy;
 }
 
 bool Value::isInitialized() const {
@@ -34,14 +60,18 @@ bool Value::isInitialized() const {
 }
 
 bool Value::isEmpty() const {
-  return strObj.empty();
+  return encodedObj.empty();
 }
 
 void Value::reset() {
   this->strObj.clear();
+  this->encodedObj.clear();
   this->initalized = false;
 }
 
+/**
+ * @return the text representation of the value.
+ */
 const string& Value::str() const {
   if(!isInitialized())
     throw value_exception() << value_info({"uinitialized value", "null"});
@@ -49,6 +79,16 @@ const string& Value::str() const {
   return this->strObj;
 }
 
+/**
+ * @return the value as it is stored in the database.
+ */
+const string& Value::encoded() const {
+  if(!isInitialized())
+    throw value_exception() << value_info({"uinitialized value", "null"});
+
+  return this->encodedObj;
+}
+
 const Value::Type Value::getType() const {
   return this->type;
 }
@@ -57,28 +97,216 @@ const size_t Value::getSize() const {
   if(!isInitialized())
     throw value_exception() << value_info({"uinitialized value", "null"});
 
+  if(type != Array && type != Object && type != Range)
+    return 1;
+
   if(isEmpty())
     throw value_exception() << value_info({"empty value", "null"});
 
   return this->size;
 }
 
+const int64_t Value::getInteger() const {
+  if(type == Integer)
+    return this->integer;
+  else if(type == Real)
+    return this->real;
+
+  throw value_exception() << value_info({"not a number", strObj});
+}
+
+const double Value::getReal() const {
+  if(type == Real)
+    return this->real;
+  else if(type == Integer)
+    return this->integer;
+
+  throw value_exception() << value_info({"not a number", strObj});
+}
+
+const bool Value::getBoolean() const {
+  if(type != Boolean)
+    throw value_exception() << value_info({"not a boolean", strObj});
+
+  return this->integer != 0;
+}
+
+bool Value::isNumber() const {
+  return type == Integer || type == Real;
+}
+
+/**
+ * @return true if the value was stored in a format written by an older version.
+ */
+bool Value::isLegacy() const {
+  return legacy;
+}
+
 void Value::init(const string& v, bool value) {
+  this->integer = 0;
+  this->real = 0;
+
   if (!value) {
-    char c = v.at(0);
-    if (c == 'A') {
-      this->type = Array;
-    } else if (c == 'O') {
-      this->type = Object;
-    } else {
-      throw value_exception() << value_info({"unknown directory descriptor", "" + c});
-    }
+    if(!decodeContainer(v.data(), v.size(), this->type, this->size))
+      throw value_exception() << value_info({"unknown directory descriptor", v});
 
-    this->size = boost::lexical_cast<size_t>(v.substr(1));
+    this->legacy = v[0] != TagArray && v[0] != TagObject;
+    this->strObj.clear();
   } else {
-    this->type = Type::String;
     this->size = 1;
+    decode(v);
+  }
+
+  this->encodedObj = v;
+}
+
+void Value::decode(const string& v) {
+  this->type = String;
+  this->legacy = false;
+
+  if(v.empty()) {
+    this->legacy = true;
+    this->strObj.clear();
+    return;
+  }
+
+  switch(static_cast<unsigned char>(v[0])) {
+    case TagString:
+      this->strObj = v.substr(1);
+      break;
+    case TagInteger: {
+      uint64_t zz = 0;
+      size_t shift = 0;
+      size_t i = 1;
+      for(; i < v.size(); ++i) {
+        const unsigned char b = v[i];
+        zz |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if(!(b & 0x80))
+          break;
+        shift += 7;
+      }
+
+      if(i >= v.size() || shift > 63)
+        throw value_exception() << value_info({"malformed integer", v});
+
+      this->type = Integer;
+      this->integer = static_cast<int64_t>(zz >> 1) ^ -static_cast<int64_t>(zz & 1);
+      this->strObj = boost::lexical_cast<string>(this->integer);
+      break;
+    }
+    case TagReal:
+      if(v.size() != 1 + sizeof(double))
+        throw value_exception() << value_info({"malformed real", v});
+
+      this->type = Real;
+      memcpy(&this->real, v.data() + 1, sizeof(double));
+      this->strObj = formatReal(this->real);
+      break;
+    case TagBoolean:
+      if(v.size() != 2)
+        throw value_exception() << value_info({"malformed boolean", v});
+
+      this->type = Boolean;
+      this->integer = v[1] ? 1 : 0;
+      this->strObj = this->integer ? "true" : "false";
+      break;
+    case TagNull:
+      this->type = Null;
+      this->strObj = "null";
+      break;
+    default:
+      this->legacy = true;
+      this->strObj = v;
+  }
+}
+
+string Value::encodeString(const string& s) {
+  string enc;
+  enc.reserve(s.size() + 1);
+  enc.push_back(TagString);
+  enc.append(s);
+  return enc;
+}
+
+string Value::encodeInteger(const int64_t i) {
+  uint64_t zz = (static_cast<uint64_t>(i) << 1) ^ static_cast<uint64_t>(i >> 63);
+  string enc(1, TagInteger);
+  do {
+    unsigned char b = zz & 0x7f;
+    zz >>= 7;
+    if(zz)
+      b |= 0x80;
+    enc.push_back(b);
+  } while(zz);
+  return enc;
+}
+
+string Value::encodeReal(const double d) {
+  string enc(1, TagReal);
+  enc.append(reinterpret_cast<const char*>(&d), sizeof(d));
+  return enc;
+}
+
+string Value::encodeBoolean(const bool b) {
+  string enc(1, TagBoolean);
+  enc.push_back(b ? 1 : 0);
+  return enc;
+}
+
+string Value::encodeNull() {
+  return string(1, TagNull);
+}
+
+string Value::encodeContainer(const Type t, const size_t size) {
+  assert(t == Array || t == Object);
+  char header[ContainerHeaderSize];
+  header[0] = t == Array ? TagArray : TagObject;
+  header[1] = ContainerVersion;
+
+  uint64_t s = size;
+  for(size_t i = 2; i < ContainerHeaderSize; ++i) {
+    header[i] = s & 0xff;
+    s >>= 8;
+  }
+  return string(header, ContainerHeaderSize);
+}
+
+/**
+ * Decodes a directory header without allocating.
+ * Accepts the fixed width binary header as well as the "A<n>"/"O<n>" text form.
+ * @return false if the data is not a valid directory header.
+ */
+bool Value::decodeContainer(const char* data, const size_t len, Type& t, size_t& size) {
+  if(len == 0)
+    return false;
+
+  const unsigned char tag = data[0];
+  if(tag == TagArray || tag == TagObject) {
+    if(len != ContainerHeaderSize || static_cast<unsigned char>(data[1]) != ContainerVersion)
+      return false;
+
+    uint64_t s = 0;
+    for(size_t i = ContainerHeaderSize; i > 2; --i)
+      s = (s << 8) | static_cast<unsigned char>(data[i - 1]);
+
+    t = tag == TagArray ? Array : Object;
+    size = s;
+    return true;
+  } else if(tag == 'A' || tag == 'O') {
+    if(len < 2)
+      return false;
+
+    size_t s = 0;
+    for(size_t i = 1; i < len; ++i) {
+      if(data[i] < '0' || data[i] > '9')
+        return false;
+      s = s * 10 + (data[i] - '0');
+    }
+
+    t = tag == 'A' ? Array : Object;
+    size = s;
+    return true;
   }
 
-  this->strObj = v;
+  return false;
 }
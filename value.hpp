@@ -2,18 +2,46 @@
 #define VALUE_HPP_
 
 #include <string>
+#include <stdint.h>
 #include "path.hpp"
 #include "exception.hpp"
 
 namespace janosh {
   using std::string;
 
+  /**
+   * A decoded database value.
+   * Leaf values are stored as a tag byte followed by the payload:
+   *   TagString  | bytes
+   *   TagInteger | zigzag varint
+   *   TagReal    | 8 byte double
+   *   TagBoolean | 1 byte
+   *   TagNull
+   * A leaf without a known tag is a plain string written by an older version.
+   *
+   * Directory headers have a fixed width of ContainerHeaderSize bytes:
+   *   TagArray/TagObject | format version | uint64 size, little endian
+   * Headers in the older "A<n>"/"O<n>" text form are still decoded.
+   */
   class Value {
   public:
     enum Type {
-      Null, String, Array, Object, Range
+      Null, String, Array, Object, Range, Integer, Real, Boolean
     };
 
+    enum Tag {
+      TagString = 0x01,
+      TagInteger = 0x02,
+      TagReal = 0x03,
+      TagBoolean = 0x04,
+      TagNull = 0x05,
+      TagArray = 0x10,
+      TagObject = 0x11
+    };
+
+    static const size_t ContainerHeaderSize = 10;
+    static const uint8_t ContainerVersion = 1;
+
     Value();
     Value(Type t);
     Value(const string& v, Type t);
@@ -23,6 +51,7 @@ namespace janosh {
     bool isEmpty() const;
     void reset();
     const string& str() const;
+    const string& encoded() const;
 
     operator string() const {
       return this->str();
@@ -33,13 +62,31 @@ namespace janosh {
     }
     const Type getType()  const;
     const size_t getSize() const;
+    const int64_t getInteger() const;
+    const double getReal() const;
+    const bool getBoolean() const;
+    bool isNumber() const;
+    bool isLegacy() const;
     void init(const string& v, bool value);
 
+    static string encodeString(const string& s);
+    static string encodeInteger(const int64_t i);
+    static string encodeReal(const double d);
+    static string encodeBoolean(const bool b);
+    static string encodeNull();
+    static string encodeContainer(const Type t, const size_t size);
+    static bool decodeContainer(const char* data, const size_t len, Type& t, size_t& size);
   private:
     string strObj;
+    string encodedObj;
     Type type;
     size_t size;
+    int64_t integer;
+    double real;
     bool initalized;
+    bool legacy;
+
+    void decode(const string& v);
   };
 
 